@@ -0,0 +1,130 @@
+#include "AsyncWriter.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+AsyncWriter::AsyncWriter(const size_t maxQueuedBytes) :
+    m_MaxQueuedBytes(maxQueuedBytes), m_Thread([this] { Loop(); })
+{
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Cv.notify_all();
+    m_Thread.join();
+}
+
+void AsyncWriter::Write(const std::filesystem::path& path, std::vector<uint8_t> bytes)
+{
+    const size_t size = bytes.size();
+    Post([this, path, bytes = std::move(bytes)]
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        std::FILE* file = nullptr;
+#ifdef _WIN32
+        _wfopen_s(&file, path.wstring().c_str(), L"wb");
+#else
+        file = std::fopen(path.string().c_str(), "wb");
+#endif
+        if (!file)
+            throw std::runtime_error("failed to open " + path.u8string());
+
+        // reserve the whole extent first so the file system lays it out contiguously
+        std::error_code ec;
+        if (bytes.size() >= (size_t(1) << 20)) std::filesystem::resize_file(path, bytes.size(), ec);
+
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        const size_t written = bytes.empty() ? 0 : std::fwrite(bytes.data(), 1, bytes.size(), file);
+        const bool closed = std::fclose(file) == 0;
+        if (written != bytes.size() || !closed)
+            throw std::runtime_error("failed to write " + path.u8string());
+
+        std::lock_guard lock(m_Mutex);
+        ++m_Files;
+        m_WrittenBytes += bytes.size();
+        m_WriteTime += std::chrono::steady_clock::now() - begin;
+    }, size);
+}
+
+void AsyncWriter::Post(std::function<void()> job, const size_t bytes)
+{
+    std::unique_lock lock(m_Mutex);
+    // a single job larger than the bound still goes through once the queue is empty
+    m_Cv.wait(lock, [this, bytes]
+    {
+        return m_QueuedBytes == 0 || m_QueuedBytes + bytes <= m_MaxQueuedBytes;
+    });
+    m_Queue.push_back({ std::move(job), bytes });
+    m_QueuedBytes += bytes;
+    m_Cv.notify_all();
+}
+
+void AsyncWriter::Flush()
+{
+    std::unique_lock lock(m_Mutex);
+    m_Cv.wait(lock, [this] { return m_Queue.empty() && !m_Busy; });
+    if (m_Error)
+    {
+        const auto error = m_Error;
+        m_Error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void AsyncWriter::Report()
+{
+    std::lock_guard lock(m_Mutex);
+    const double seconds = std::chrono::duration<double>(m_WriteTime).count();
+    std::printf("%zu files, %.1f MB written in %.2f s (%.0f MB/s)\n", m_Files, m_WrittenBytes / 1048576.0,
+        seconds, seconds > 0.0 ? m_WrittenBytes / 1048576.0 / seconds : 0.0);
+}
+
+uint64_t AsyncWriter::WrittenBytes()
+{
+    std::lock_guard lock(m_Mutex);
+    return m_WrittenBytes;
+}
+
+double AsyncWriter::WriteSeconds()
+{
+    std::lock_guard lock(m_Mutex);
+    return std::chrono::duration<double>(m_WriteTime).count();
+}
+
+void AsyncWriter::Loop()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Cv.wait(lock, [this] { return m_Stop || !m_Queue.empty(); });
+            if (m_Queue.empty()) return;
+            job = std::move(m_Queue.front());
+            m_Queue.pop_front();
+            m_Busy = true;
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            job.Run();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard lock(m_Mutex);
+            if (error && !m_Error) m_Error = error;
+            m_QueuedBytes -= job.Bytes;
+            m_Busy = false;
+        }
+        m_Cv.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Output stage with its own thread. Workers hand over finished buffers and move on, files are written
+// in order with one preallocated sequential write each. The queue is bounded by bytes, producers only
+// wait when the disk falls that far behind.
+class AsyncWriter
+{
+public:
+    explicit AsyncWriter(size_t maxQueuedBytes = size_t(256) << 20);
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void Write(const std::filesystem::path& path, std::vector<uint8_t> bytes);
+
+    template <class T>
+    void Write(const std::filesystem::path& path, const std::vector<T>& data)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "write raw bytes only");
+        const auto* p = reinterpret_cast<const uint8_t*>(data.data());
+        Write(path, std::vector<uint8_t>(p, p + data.size() * sizeof(T)));
+    }
+
+    // Runs job on the writer thread after everything queued before it, bytes counts against the bound.
+    void Post(std::function<void()> job, size_t bytes = 0);
+
+    // Waits for the queue to drain and rethrows the first failed job.
+    void Flush();
+
+    // prints files, bytes and throughput written so far
+    void Report();
+
+    [[nodiscard]] uint64_t WrittenBytes();
+    [[nodiscard]] double WriteSeconds();
+
+private:
+    struct Job
+    {
+        std::function<void()> Run;
+        size_t Bytes;
+    };
+
+    void Loop();
+
+    const size_t m_MaxQueuedBytes;
+    std::deque<Job> m_Queue;
+    size_t m_QueuedBytes = 0;
+    bool m_Busy = false;
+    bool m_Stop = false;
+    std::exception_ptr m_Error;
+
+    size_t m_Files = 0;
+    uint64_t m_WrittenBytes = 0;
+    std::chrono::steady_clock::duration m_WriteTime {};
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Cv;
+    std::thread m_Thread;
+};
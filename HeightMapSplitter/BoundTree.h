@@ -1,7 +1,11 @@
 #pragma once
 
 #include <nlohmann/json.hpp>
+#include <algorithm>
 #include <fstream>
+#include <functional>
+
+#include "HeightPyramid.h"
 
 class BoundTree
 {
@@ -15,15 +19,32 @@ public:
         int AreaX = -1;
         int AreaY = -1;
         int PatchIdx = -1;
+        int HlodIdx = -1;   // merged far field mesh of an internal node, -1 when there is none
     };
 
+    // An HLOD mesh stores its positions in units of 2^level pixels from the node's corner, the
+    // smallest power of two that brings the node's extent back into the 0 ~ 255 range of a patch.
+    static int HlodLevel(const Bound& b)
+    {
+        const int patches = static_cast<int>(std::ceil(std::max(b.AreaWidth, b.AreaHeight) / 255.0f));
+        int level = 0;
+        while ((1 << level) < patches) ++level;
+        return level;
+    }
+
     BoundTree(const std::vector<std::pair<float, float>>& patchBounds, int patchNx);
+    // Every node queries the pyramid for its own area instead of merging its children. Patches empty()
+    // holds for are fully masked and get a leaf without a patch, a node with only such leaves below
+    // becomes one itself.
+    BoundTree(const HeightPyramid& pyramid, int patchNx, int patchNy,
+        const std::function<bool(int x, int y)>& empty = nullptr);
     BoundTree(const nlohmann::json& json);
     ~BoundTree() = default;
 
     void SaveJson(const std::filesystem::path& path) const;
 
     friend class TerrainSystem;
+    friend class HlodBuilder;
 
 private:
     struct Node
@@ -120,6 +141,55 @@ inline BoundTree::BoundTree(const std::vector<std::pair<float, float>>& patchBou
     m_Root = recursiveBuild(bounds, patchNx, 0, 0);
 }
 
+inline BoundTree::BoundTree(const HeightPyramid& pyramid, const int patchNx, const int patchNy,
+    const std::function<bool(int x, int y)>& empty)
+{
+    constexpr int PATCH_SIZE = 255;
+
+    // same quadrant split as the patch bound constructor so both produce identical trees
+    std::function<std::unique_ptr<Node>(int, int, int, int)> recursiveBuild =
+        [&recursiveBuild, &pyramid, &empty, patchNx](
+        const int w, const int h, const int xStart, const int yStart) -> std::unique_ptr<Node>
+    {
+        if (w <= 0 || h <= 0) return nullptr;
+
+        const auto area = pyramid.Query(xStart * PATCH_SIZE, yStart * PATCH_SIZE,
+            (xStart + w) * PATCH_SIZE, (yStart + h) * PATCH_SIZE);
+        Bound b;
+        b.HMin = area.Min;
+        b.HMax = area.Max;
+        b.AreaX = xStart;
+        b.AreaY = yStart;
+        if (w == 1 && h == 1)
+        {
+            b.PatchIdx = empty && empty(xStart, yStart) ? -1 : yStart * patchNx + xStart;
+            b.AreaWidth = PATCH_SIZE;
+            b.AreaHeight = PATCH_SIZE;
+            return std::make_unique<Node>(b);
+        }
+        b.AreaWidth = static_cast<float>(w * PATCH_SIZE);
+        b.AreaHeight = static_cast<float>(h * PATCH_SIZE);
+
+        const int childW = w / 2;
+        const int childH = h / 2;
+        auto node = std::make_unique<Node>(b,
+            recursiveBuild(childW, childH, xStart, yStart),
+            recursiveBuild(w - childW, childH, xStart + childW, yStart),
+            recursiveBuild(childW, h - childH, xStart, yStart + childH),
+            recursiveBuild(w - childW, h - childH, xStart + childW, yStart + childH));
+        const bool hollow = std::all_of(std::begin(node->m_Children), std::end(node->m_Children),
+            [](const std::unique_ptr<Node>& child)
+            {
+                return !child || (child->m_Bound.PatchIdx < 0 && std::none_of(std::begin(child->m_Children),
+                    std::end(child->m_Children), [](const std::unique_ptr<Node>& c) { return c != nullptr; }));
+            });
+        if (hollow)
+            for (auto& child : node->m_Children) child.reset();
+        return node;
+    };
+    m_Root = recursiveBuild(patchNx, patchNy, 0, 0);
+}
+
 inline BoundTree::BoundTree(const nlohmann::json& json)
 {
     std::function<std::unique_ptr<Node>(const nlohmann::json&)> recursiveBuild =
@@ -139,6 +209,7 @@ inline BoundTree::BoundTree(const nlohmann::json& json)
         b.AreaY = j["y"].get<int>();
         b.AreaWidth = j["w"].get<float>();
         b.AreaHeight = j["h"].get<float>();
+        b.HlodIdx = j.value("hlod", -1);
         return std::make_unique<Node>(b,
             std::move(children[0]), std::move(children[1]),
             std::move(children[2]), std::move(children[3]));
@@ -159,6 +230,7 @@ inline void BoundTree::SaveJson(const std::filesystem::path& path) const
         j["w"] = node->m_Bound.AreaWidth;
         j["h"] = node->m_Bound.AreaHeight;
         j["pid"] = node->m_Bound.PatchIdx;
+        j["hlod"] = node->m_Bound.HlodIdx;
         for (int i = 0; i < 4; ++i)
         {
             if (node->m_Children[i])
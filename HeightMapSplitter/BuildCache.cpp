@@ -0,0 +1,132 @@
+#include "BuildCache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <process.h>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace
+{
+    uint64_t Mix(uint64_t v)
+    {
+        v ^= v >> 30;
+        v *= 0xbf58476d1ce4e5b9ull;
+        v ^= v >> 27;
+        v *= 0x94d049bb133111ebull;
+        return v ^ v >> 31;
+    }
+
+    uint64_t Load64(const uint8_t* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+}
+
+ContentHash& ContentHash::Add(const void* data, const size_t size)
+{
+    const auto* p = static_cast<const uint8_t*>(data);
+    size_t i = 0;
+
+    // four independent lanes keep the multipliers busy, then fold into the running state
+    if (size >= 32)
+    {
+        uint64_t lanes[4] = { m_State, m_State ^ 1, m_State ^ 2, m_State ^ 3 };
+        for (; i + 32 <= size; i += 32)
+            for (int k = 0; k < 4; ++k)
+                lanes[k] = (lanes[k] ^ Mix(Load64(p + i + k * 8))) * 0x9fb21c651e98df25ull;
+        for (const uint64_t lane : lanes)
+            m_State = Mix(m_State ^ lane);
+    }
+    for (; i + 8 <= size; i += 8)
+        m_State = (m_State ^ Mix(Load64(p + i))) * 0x9fb21c651e98df25ull;
+    if (i < size)
+    {
+        uint64_t tail = 0;
+        std::memcpy(&tail, p + i, size - i);
+        m_State = (m_State ^ Mix(tail ^ (size - i) << 56)) * 0x9fb21c651e98df25ull;
+    }
+    m_Length += size;
+    return *this;
+}
+
+ContentHash& ContentHash::AddFile(const std::filesystem::path& path)
+{
+    std::ifstream ifs(path, std::ios::binary | std::ios::in);
+    if (!ifs)
+        throw std::runtime_error("failed to open " + path.u8string());
+
+    std::vector<char> buffer(1 << 20);
+    while (ifs)
+    {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        Add(buffer.data(), static_cast<size_t>(ifs.gcount()));
+    }
+    return *this;
+}
+
+uint64_t ContentHash::Value() const
+{
+    return Mix(m_State ^ Mix(m_Length));
+}
+
+BuildCache::BuildCache(std::filesystem::path dir, const bool enabled) :
+    m_Dir(std::move(dir)), m_Enabled(enabled)
+{
+    if (m_Enabled) create_directories(m_Dir);
+}
+
+std::filesystem::path BuildCache::EntryPath(const uint64_t key) const
+{
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return m_Dir / name;
+}
+
+bool BuildCache::Restore(const uint64_t key, const std::filesystem::path& dir) const
+{
+    if (!m_Enabled) return false;
+    const auto entry = EntryPath(key);
+    std::error_code ec;
+    if (!is_directory(entry, ec)) return false;
+
+    create_directories(dir);
+    for (auto&& file : std::filesystem::directory_iterator(entry))
+        copy_file(file.path(), dir / file.path().filename(), std::filesystem::copy_options::overwrite_existing);
+    return true;
+}
+
+void BuildCache::Store(const uint64_t key, const std::vector<std::filesystem::path>& files) const
+{
+    if (!m_Enabled) return;
+    const auto entry = EntryPath(key);
+    std::error_code ec;
+    if (is_directory(entry, ec)) return;
+
+    // fill a private directory first, readers only ever see complete entries. The process id and a counter
+    // keep the staging directories of every store of every concurrent build apart.
+    static std::atomic<uint64_t> stores = 0;
+    const std::filesystem::path staging = entry.u8string() + "." + std::to_string(_getpid()) + "." +
+        std::to_string(stores++) + ".tmp";
+    create_directories(staging);
+    for (const auto& file : files)
+        copy_file(file, staging / file.filename(), std::filesystem::copy_options::overwrite_existing);
+
+    std::filesystem::rename(staging, entry, ec);
+    // someone published the same key first, their files are identical
+    if (ec) std::filesystem::remove_all(staging);
+}
+
+void BuildCache::StoreDirectory(const uint64_t key, const std::filesystem::path& dir) const
+{
+    if (!m_Enabled) return;
+    std::vector<std::filesystem::path> files;
+    for (auto&& entry : std::filesystem::directory_iterator(dir))
+        if (entry.is_regular_file()) files.push_back(entry.path());
+    Store(key, files);
+}
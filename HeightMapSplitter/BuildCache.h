@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// 64 bit content hash for cache keys, mixes 8 bytes at a time.
+class ContentHash
+{
+public:
+    ContentHash& Add(const void* data, size_t size);
+
+    template <class T>
+    ContentHash& Add(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "hash raw bytes only");
+        return Add(&value, sizeof(T));
+    }
+
+    template <class T>
+    ContentHash& Add(const std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "hash raw bytes only");
+        Add(values.size());
+        return Add(values.data(), values.size() * sizeof(T));
+    }
+
+    ContentHash& Add(std::string_view text)
+    {
+        Add(text.size());
+        return Add(text.data(), text.size());
+    }
+
+    ContentHash& Add(const char* text) { return Add(std::string_view(text)); }
+
+    // hashes the bytes of a file, throws when it cannot be read
+    ContentHash& AddFile(const std::filesystem::path& path);
+
+    [[nodiscard]] uint64_t Value() const;
+
+private:
+    uint64_t m_State = 0x9e3779b97f4a7c15ull;
+    uint64_t m_Length = 0;
+};
+
+// Output cache keyed by content hash. An entry holds the files one build step wrote into a directory,
+// restoring it copies them back, so a step whose inputs hash the same is skipped entirely.
+// Entries are published with a directory rename, concurrent steps can store and restore freely
+// and two steps racing for the same key both end up with a complete entry.
+class BuildCache
+{
+public:
+    // a disabled cache never hits and stores nothing
+    BuildCache(std::filesystem::path dir, bool enabled = true);
+
+    // copies the entry for key into dir, false when there is none
+    bool Restore(uint64_t key, const std::filesystem::path& dir) const;
+
+    // keeps copies of files under key
+    void Store(uint64_t key, const std::vector<std::filesystem::path>& files) const;
+
+    // keeps every regular file directly inside dir under key
+    void StoreDirectory(uint64_t key, const std::filesystem::path& dir) const;
+
+private:
+    [[nodiscard]] std::filesystem::path EntryPath(uint64_t key) const;
+
+    std::filesystem::path m_Dir;
+    bool m_Enabled;
+};
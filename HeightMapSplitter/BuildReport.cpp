@@ -0,0 +1,147 @@
+#include "BuildReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+void BuildReport::Span(const char* name, const int x, const int y, const Clock::time_point begin,
+    const Clock::time_point end)
+{
+    std::lock_guard lock(m_Mutex);
+    m_Spans.push_back({ name, x, y, ThreadIndex(), begin, end });
+}
+
+void BuildReport::Add(const std::string& counter, const double value)
+{
+    std::lock_guard lock(m_Mutex);
+    m_Counters[counter] += value;
+}
+
+void BuildReport::AddPatch(const int x, const int y, const std::string& key, const double value)
+{
+    std::lock_guard lock(m_Mutex);
+    m_Patches[{ x, y }][key] += value;
+}
+
+int BuildReport::ThreadIndex()
+{
+    return m_Threads.emplace(std::this_thread::get_id(), static_cast<int>(m_Threads.size())).first->second;
+}
+
+uint64_t BuildReport::PeakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+void BuildReport::Save(const std::filesystem::path& path, const std::filesystem::path& tracePath)
+{
+    std::lock_guard lock(m_Mutex);
+    const auto ms = [](const Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    // per stage durations, nearest rank percentiles
+    std::map<std::string, std::vector<double>> stages;
+    for (const auto& span : m_Spans)
+    {
+        stages[span.Name].push_back(ms(span.End - span.Begin));
+        if (span.X >= 0) m_Patches[{ span.X, span.Y }][std::string(span.Name) + "_ms"] += ms(span.End - span.Begin);
+    }
+
+    nlohmann::json report;
+    report["elapsed_s"] = ms(Clock::now() - m_Begin) / 1000.0;
+    report["peak_rss_mb"] = PeakRss() / 1048576.0;
+    report["threads"] = m_Threads.size();
+    report["counters"] = m_Counters;
+
+    auto& stageJson = report["stages"];
+    for (auto& [name, durations] : stages)
+    {
+        std::sort(durations.begin(), durations.end());
+        const auto percentile = [&durations](const double p)
+        {
+            const size_t rank = static_cast<size_t>(std::ceil(p * durations.size()));
+            return durations[std::clamp<size_t>(rank, 1, durations.size()) - 1];
+        };
+        double total = 0.0;
+        for (const double d : durations) total += d;
+        stageJson[name] = {
+            { "count", durations.size() },
+            { "total_ms", total },
+            { "min_ms", durations.front() },
+            { "p50_ms", percentile(0.5) },
+            { "p90_ms", percentile(0.9) },
+            { "p99_ms", percentile(0.99) },
+            { "max_ms", durations.back() },
+        };
+    }
+
+    // one row per patch, the slowest first by the time spent in all of its spans
+    std::vector<std::pair<double, nlohmann::json>> rows;
+    for (const auto& [xy, values] : m_Patches)
+    {
+        nlohmann::json row = values;
+        row["x"] = xy.first;
+        row["y"] = xy.second;
+        double total = 0.0;
+        for (const auto& [key, value] : values)
+            if (key.size() > 3 && key.compare(key.size() - 3, 3, "_ms") == 0) total += value;
+        row["total_ms"] = total;
+        rows.emplace_back(total, std::move(row));
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    auto& slowest = report["slowest_patches"] = nlohmann::json::array();
+    auto& patches = report["patches"] = nlohmann::json::array();
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        if (i < 20) slowest.push_back({ { "x", rows[i].second["x"] }, { "y", rows[i].second["y"] },
+            { "total_ms", rows[i].first } });
+        patches.push_back(std::move(rows[i].second));
+    }
+
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("failed to open " + path.u8string());
+    file << report.dump(2);
+    std::printf("%s generated\n", path.u8string().c_str());
+
+    if (tracePath.empty()) return;
+    auto events = nlohmann::json::array();
+    for (const auto& span : m_Spans)
+    {
+        nlohmann::json event = {
+            { "name", span.Name },
+            { "cat", span.X >= 0 ? "patch" : "stage" },
+            { "ph", "X" },
+            { "ts", std::chrono::duration<double, std::micro>(span.Begin - m_Begin).count() },
+            { "dur", std::chrono::duration<double, std::micro>(span.End - span.Begin).count() },
+            { "pid", 1 },
+            { "tid", span.Thread },
+        };
+        if (span.X >= 0) event["args"] = { { "x", span.X }, { "y", span.Y } };
+        events.push_back(std::move(event));
+    }
+    std::ofstream trace(tracePath);
+    if (!trace)
+        throw std::runtime_error("failed to open " + tracePath.u8string());
+    trace << nlohmann::json { { "traceEvents", events }, { "displayTimeUnit", "ms" } }.dump();
+    std::printf("%s generated\n", tracePath.u8string().c_str());
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Timings and counters of one build. Stages and patch tasks record spans from any thread. Save()
+// writes a JSON report with per-stage totals and percentiles, the slowest patches, one row per
+// patch and the counters. It can also write a Chrome trace (chrome://tracing, ui.perfetto.dev) with
+// one event per span, so the critical path of a large build can be seen.
+class BuildReport
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // times a span from construction to destruction, patch spans carry the patch coordinates
+    class Scope
+    {
+    public:
+        Scope(BuildReport& report, const char* name, int x = -1, int y = -1) :
+            m_Report(report), m_Name(name), m_X(x), m_Y(y), m_Begin(Clock::now()) {}
+        ~Scope() { m_Report.Span(m_Name, m_X, m_Y, m_Begin, Clock::now()); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        BuildReport& m_Report;
+        const char* m_Name;
+        const int m_X;
+        const int m_Y;
+        const Clock::time_point m_Begin;
+    };
+
+    BuildReport() : m_Begin(Clock::now()) {}
+
+    void Span(const char* name, int x, int y, Clock::time_point begin, Clock::time_point end);
+
+    // build wide counter, values add up
+    void Add(const std::string& counter, double value);
+
+    // value reported in the row of patch (x, y), values add up
+    void AddPatch(int x, int y, const std::string& key, double value);
+
+    // tracePath empty skips the trace
+    void Save(const std::filesystem::path& path, const std::filesystem::path& tracePath = {});
+
+    // peak resident set of the process in bytes so far
+    static uint64_t PeakRss();
+
+private:
+    struct SpanRecord
+    {
+        const char* Name;
+        int X;
+        int Y;
+        int Thread;
+        Clock::time_point Begin;
+        Clock::time_point End;
+    };
+
+    int ThreadIndex();
+
+    const Clock::time_point m_Begin;
+    std::vector<SpanRecord> m_Spans;
+    std::map<std::string, double> m_Counters;
+    std::map<std::pair<int, int>, std::map<std::string, double>> m_Patches;
+    std::map<std::thread::id, int> m_Threads;
+    std::mutex m_Mutex;
+};
@@ -0,0 +1,73 @@
+#include "ClusterBuilder.h"
+
+#include <algorithm>
+#include <limits>
+#include <glm/glm.hpp>
+#include <meshoptimizer.h>
+
+std::vector<PatchArchive::Cluster> ClusterBuilder::Build(
+    const std::vector<Triangulator::PackedPoint>& vertices, std::vector<uint32_t>& indices,
+    const Heightmap& heightmap, const float heightScale)
+{
+    if (indices.empty()) return {};
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        positions[i] = glm::vec3(vertices[i].PosX, heightmap.At(vertices[i].PosX, vertices[i].PosY) * heightScale,
+            vertices[i].PosY);
+
+    constexpr size_t maxVertices = PatchArchive::ClusterVertices;
+    constexpr size_t maxTriangles = PatchArchive::ClusterTriangles;
+    const size_t maxMeshlets = meshopt_buildMeshletsBound(indices.size(), maxVertices, maxTriangles);
+    std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+    std::vector<unsigned int> meshletVertices(maxMeshlets * maxVertices);
+    std::vector<unsigned char> meshletTriangles(maxMeshlets * maxTriangles * 3);
+    meshlets.resize(meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+        indices.data(), indices.size(), &positions[0].x, positions.size(), sizeof(glm::vec3),
+        maxVertices, maxTriangles, 0.5f));
+
+    // meshopt takes cross(p1 - p0, p2 - p0) as the front, a height field facing the other way
+    // gets its cones flipped so they describe the side the viewer sees
+    float up = 0.0f;
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const glm::vec3& p0 = positions[indices[t]];
+        up += glm::cross(positions[indices[t + 1]] - p0, positions[indices[t + 2]] - p0).y;
+    }
+    const float flip = up < 0.0f ? -1.0f : 1.0f;
+
+    std::vector<PatchArchive::Cluster> clusters;
+    clusters.reserve(meshlets.size());
+    std::vector<uint32_t> reordered;
+    reordered.reserve(indices.size());
+    for (const auto& m : meshlets)
+    {
+        const unsigned int* local = &meshletVertices[m.vertex_offset];
+        const unsigned char* triangles = &meshletTriangles[m.triangle_offset];
+        const meshopt_Bounds bounds = meshopt_computeMeshletBounds(local, triangles, m.triangle_count,
+            &positions[0].x, positions.size(), sizeof(glm::vec3));
+
+        PatchArchive::Cluster c {};
+        std::copy_n(bounds.center, 3, c.Center);
+        c.Radius = bounds.radius;
+        for (int k = 0; k < 3; ++k)
+            c.ConeAxis[k] = bounds.cone_axis[k] * flip;
+        c.ConeCutoff = bounds.cone_cutoff;
+        c.MinHeight = std::numeric_limits<float>::max();
+        c.MaxHeight = std::numeric_limits<float>::lowest();
+        for (unsigned int v = 0; v < m.vertex_count; ++v)
+        {
+            const auto& p = vertices[local[v]];
+            c.MinHeight = std::min(c.MinHeight, heightmap.At(p.PosX, p.PosY));
+            c.MaxHeight = std::max(c.MaxHeight, heightmap.At(p.PosX, p.PosY));
+        }
+        c.IndexOffset = static_cast<uint32_t>(reordered.size());
+        c.TriangleCount = m.triangle_count;
+        for (unsigned int i = 0; i < m.triangle_count * 3; ++i)
+            reordered.push_back(local[triangles[i]]);
+        clusters.push_back(c);
+    }
+
+    indices = std::move(reordered);
+    return clusters;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+#include "heightmap.h"
+#include "PatchArchive.h"
+#include "triangulator.h"
+
+// Splits a patch LOD into meshlets of at most PatchArchive::ClusterVertices vertices and
+// ClusterTriangles triangles and bounds each one for culling. The D3D11 viewer draws index ranges,
+// so the 8-bit local indices meshopt produces are expanded back in place: indices comes out
+// reordered cluster by cluster, with cluster i covering [IndexOffset, IndexOffset + 3 * TriangleCount).
+struct ClusterBuilder
+{
+    // positions are (PosX, height * heightScale, PosY), the frame the viewer places a patch in
+    static std::vector<PatchArchive::Cluster> Build(
+        const std::vector<Triangulator::PackedPoint>& vertices, std::vector<uint32_t>& indices,
+        const Heightmap& heightmap, float heightScale);
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "Parallel.h"
+
+// Min / max / mean mip pyramid over a normalized heightmap.
+// Cell (x, y) of level l covers pixels [x * s, (x + 1) * s] inclusive with s = CellSize << l, so a cell
+// also contains the shared row / column of its right and bottom neighbours, like patches and clipmap blocks do.
+// Values are quantized to 16 bit with min rounded down and max rounded up, which keeps every query conservative.
+class HeightPyramid
+{
+public:
+    struct Bound
+    {
+        float Min = 0.0f;
+        float Max = 0.0f;
+        float Mean = 0.0f;
+    };
+
+    static constexpr int DefaultCellSize = 16;
+
+    HeightPyramid() = default;
+
+    // sample(x, y) returns the normalized height of pixel (x, y).
+    template <class Sampler>
+    HeightPyramid(int width, int height, Sampler&& sample, int cellSize = DefaultCellSize);
+
+    // Streamed instead, for maps that do not fit in memory: AddRows() takes the rows top to bottom and the
+    // levels are built once the last one is in.
+    HeightPyramid(int width, int height, int cellSize = DefaultCellSize);
+
+    // rows [y0, y1), sample(x, y) only has to answer for them
+    template <class Sampler>
+    void AddRows(int y0, int y1, Sampler&& sample);
+
+    explicit HeightPyramid(const std::filesystem::path& path);
+
+    void Save(const std::filesystem::path& path) const;
+
+    // Bound of pixels [x0, x1] x [y0, y1] inclusive, reads at most 3 x 3 cells.
+    [[nodiscard]] Bound Query(int x0, int y0, int x1, int y1) const;
+
+    // Same as Query but the map repeats, as the viewer's tiled source does.
+    [[nodiscard]] Bound QueryPeriodic(int x0, int y0, int x1, int y1) const;
+
+    [[nodiscard]] Bound Root() const { return Decode(m_Levels.back().front()); }
+
+    [[nodiscard]] int Width() const { return m_Width; }
+    [[nodiscard]] int Height() const { return m_Height; }
+    [[nodiscard]] int CellSize() const { return m_CellSize; }
+    [[nodiscard]] int LevelCount() const { return static_cast<int>(m_Levels.size()); }
+
+private:
+    struct Cell
+    {
+        uint16_t Min;
+        uint16_t Max;
+        uint16_t Mean;
+    };
+
+    // a base cell while its rows stream in
+    struct Partial
+    {
+        float Min = std::numeric_limits<float>::max();
+        float Max = std::numeric_limits<float>::lowest();
+        double Sum = 0.0;
+    };
+
+    struct Header
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t CellSize;
+        uint32_t LevelCount;
+    };
+
+    static constexpr char Magic[4] = { 'H', 'P', 'Y', 'R' };
+    static constexpr uint32_t Version = 1;
+
+    static Bound Decode(const Cell& c)
+    {
+        constexpr float m = 1.0f / 65535.0f;
+        return { c.Min * m, c.Max * m, c.Mean * m };
+    }
+
+    static uint16_t Quantize(const float v)
+    {
+        return static_cast<uint16_t>(std::clamp(v, 0.0f, 65535.0f));
+    }
+
+    static Cell Encode(const float lo, const float hi, const float mean)
+    {
+        return {
+            Quantize(std::floor(lo * 65535.0f)),
+            Quantize(std::ceil(hi * 65535.0f)),
+            Quantize(std::round(mean * 65535.0f)),
+        };
+    }
+
+    [[nodiscard]] int LevelWidth(const int l) const { return std::max(1, (m_BaseX + (1 << l) - 1) >> l); }
+    [[nodiscard]] int LevelHeight(const int l) const { return std::max(1, (m_BaseY + (1 << l) - 1) >> l); }
+
+    void Allocate();
+    void BuildLevels();
+
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_CellSize = DefaultCellSize;
+    int m_BaseX = 0;
+    int m_BaseY = 0;
+    std::vector<std::vector<Cell>> m_Levels {};
+    std::vector<Partial> m_Partial {};  // two base rows, by cell row parity, while streaming
+    int m_RowsAdded = 0;
+};
+
+template <class Sampler>
+HeightPyramid::HeightPyramid(const int width, const int height, Sampler&& sample, const int cellSize) :
+    m_Width(width), m_Height(height), m_CellSize(cellSize)
+{
+    if (width <= 0 || height <= 0 || cellSize <= 0 || (cellSize & (cellSize - 1)) != 0)
+        throw std::runtime_error("invalid height pyramid layout");
+
+    Allocate();
+
+    auto& base = m_Levels.front();
+    ParallelFor(0, m_BaseY, ParallelGrain(m_BaseY), [&](const int cy0, const int cy1)
+    {
+        for (int cy = cy0; cy < cy1; ++cy)
+        {
+            const int y0 = cy * m_CellSize;
+            const int y1 = std::min(y0 + m_CellSize, m_Height - 1);
+            for (int cx = 0; cx < m_BaseX; ++cx)
+            {
+                const int x0 = cx * m_CellSize;
+                const int x1 = std::min(x0 + m_CellSize, m_Width - 1);
+                float lo = std::numeric_limits<float>::max();
+                float hi = std::numeric_limits<float>::lowest();
+                double sum = 0.0;
+                for (int y = y0; y <= y1; ++y)
+                {
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        const float h = sample(x, y);
+                        lo = std::min(lo, h);
+                        hi = std::max(hi, h);
+                        sum += h;
+                    }
+                }
+                base[cy * m_BaseX + cx] = Encode(lo, hi, static_cast<float>(sum / ((x1 - x0 + 1) * (y1 - y0 + 1))));
+            }
+        }
+    });
+
+    BuildLevels();
+}
+
+inline HeightPyramid::HeightPyramid(const int width, const int height, const int cellSize) :
+    m_Width(width), m_Height(height), m_CellSize(cellSize)
+{
+    if (width <= 0 || height <= 0 || cellSize <= 0 || (cellSize & (cellSize - 1)) != 0)
+        throw std::runtime_error("invalid height pyramid layout");
+
+    Allocate();
+    m_Partial.resize(2 * static_cast<size_t>(m_BaseX));
+}
+
+template <class Sampler>
+void HeightPyramid::AddRows(const int y0, const int y1, Sampler&& sample)
+{
+    if (y0 != m_RowsAdded || y1 < y0 || y1 > m_Height || m_Partial.empty())
+        throw std::runtime_error("height pyramid rows out of order");
+
+    // A row belongs to the cell row it starts in and, on a cell boundary, to the one above as well. Each
+    // cell is encoded as soon as its last row is in and its slot reused by the cell row two further down.
+    auto& base = m_Levels.front();
+    ParallelFor(0, m_BaseX, ParallelGrain(m_BaseX), [&](const int cx0, const int cx1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int cy = y / m_CellSize; cy >= 0 && cy >= y / m_CellSize - 1; --cy)
+            {
+                const int cellEnd = std::min(cy * m_CellSize + m_CellSize, m_Height - 1);
+                if (cy >= m_BaseY || y > cellEnd) continue;
+                for (int cx = cx0; cx < cx1; ++cx)
+                {
+                    auto& p = m_Partial[(cy & 1) * m_BaseX + cx];
+                    const int x0 = cx * m_CellSize;
+                    const int x1 = std::min(x0 + m_CellSize, m_Width - 1);
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        const float h = sample(x, y);
+                        p.Min = std::min(p.Min, h);
+                        p.Max = std::max(p.Max, h);
+                        p.Sum += h;
+                    }
+                    if (y < cellEnd) continue;
+                    const int rows = cellEnd - cy * m_CellSize + 1;
+                    base[cy * m_BaseX + cx] = Encode(p.Min, p.Max, static_cast<float>(p.Sum / ((x1 - x0 + 1) * rows)));
+                    p = Partial();
+                }
+            }
+        }
+    });
+
+    m_RowsAdded = y1;
+    if (m_RowsAdded == m_Height)
+    {
+        std::vector<Partial>().swap(m_Partial);
+        BuildLevels();
+    }
+}
+
+inline HeightPyramid::HeightPyramid(const std::filesystem::path& path)
+{
+    std::ifstream ifs(path, std::ios::binary | std::ios::in);
+    if (!ifs)
+        throw std::runtime_error("failed to open " + path.u8string());
+
+    Header header {};
+    ifs.read(reinterpret_cast<char*>(&header), sizeof(Header));
+    if (!ifs || !std::equal(std::begin(Magic), std::end(Magic), header.Magic) || header.Version != Version)
+        throw std::runtime_error("invalid height pyramid " + path.u8string());
+
+    m_Width = static_cast<int>(header.Width);
+    m_Height = static_cast<int>(header.Height);
+    m_CellSize = static_cast<int>(header.CellSize);
+    Allocate();
+    if (m_Levels.size() != header.LevelCount)
+        throw std::runtime_error("height pyramid level mismatch " + path.u8string());
+
+    for (auto& level : m_Levels)
+        ifs.read(reinterpret_cast<char*>(level.data()), level.size() * sizeof(Cell));
+    if (!ifs)
+        throw std::runtime_error("truncated height pyramid " + path.u8string());
+}
+
+inline void HeightPyramid::Save(const std::filesystem::path& path) const
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::out);
+    if (!ofs)
+        throw std::runtime_error("failed to open " + path.u8string());
+
+    Header header {};
+    std::copy(std::begin(Magic), std::end(Magic), header.Magic);
+    header.Version = Version;
+    header.Width = m_Width;
+    header.Height = m_Height;
+    header.CellSize = m_CellSize;
+    header.LevelCount = static_cast<uint32_t>(m_Levels.size());
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    for (const auto& level : m_Levels)
+        ofs.write(reinterpret_cast<const char*>(level.data()), level.size() * sizeof(Cell));
+}
+
+inline HeightPyramid::Bound HeightPyramid::Query(int x0, int y0, int x1, int y1) const
+{
+    x0 = std::clamp(x0, 0, m_Width - 1);
+    x1 = std::clamp(x1, x0, m_Width - 1);
+    y0 = std::clamp(y0, 0, m_Height - 1);
+    y1 = std::clamp(y1, y0, m_Height - 1);
+
+    // coarsest level whose cells are at least half the rect, so it spans no more than 3 cells per axis
+    const int extent = std::max(x1 - x0, y1 - y0);
+    int l = 0;
+    while (l + 1 < LevelCount() && (m_CellSize << (l + 1)) <= extent * 2)
+        ++l;
+
+    const int s = m_CellSize << l;
+    const int w = LevelWidth(l);
+    const int h = LevelHeight(l);
+    const int cx0 = std::min(x0 / s, w - 1);
+    const int cy0 = std::min(y0 / s, h - 1);
+    const int cx1 = std::clamp((x1 - 1) / s, cx0, w - 1);
+    const int cy1 = std::clamp((y1 - 1) / s, cy0, h - 1);
+
+    const auto& level = m_Levels[l];
+    uint16_t lo = std::numeric_limits<uint16_t>::max();
+    uint16_t hi = 0;
+    uint32_t sum = 0;
+    for (int cy = cy0; cy <= cy1; ++cy)
+    {
+        for (int cx = cx0; cx <= cx1; ++cx)
+        {
+            const auto& c = level[cy * w + cx];
+            lo = std::min(lo, c.Min);
+            hi = std::max(hi, c.Max);
+            sum += c.Mean;
+        }
+    }
+    const auto n = static_cast<uint32_t>((cx1 - cx0 + 1) * (cy1 - cy0 + 1));
+    return Decode({ lo, hi, static_cast<uint16_t>(sum / n) });
+}
+
+inline HeightPyramid::Bound HeightPyramid::QueryPeriodic(int x0, int y0, int x1, int y1) const
+{
+    if (x1 - x0 >= m_Width || y1 - y0 >= m_Height) return Root();
+
+    const auto wrap = [](const int v, const int m) { return (v % m + m) % m; };
+    const int wx = wrap(x0, m_Width);
+    const int wy = wrap(y0, m_Height);
+    x1 = wx + x1 - x0;
+    y1 = wy + y1 - y0;
+
+    // split the rect where it crosses the seam of the repeated map
+    const int xs[][2] = { { wx, std::min(x1, m_Width - 1) }, { 0, x1 - m_Width } };
+    const int ys[][2] = { { wy, std::min(y1, m_Height - 1) }, { 0, y1 - m_Height } };
+    Bound b { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.0f };
+    int n = 0;
+    for (const auto& ry : ys)
+    {
+        if (ry[1] < ry[0]) continue;
+        for (const auto& rx : xs)
+        {
+            if (rx[1] < rx[0]) continue;
+            const auto q = Query(rx[0], ry[0], rx[1], ry[1]);
+            b.Min = std::min(b.Min, q.Min);
+            b.Max = std::max(b.Max, q.Max);
+            b.Mean += q.Mean;
+            ++n;
+        }
+    }
+    b.Mean /= static_cast<float>(n);
+    return b;
+}
+
+inline void HeightPyramid::Allocate()
+{
+    m_BaseX = std::max(1, (m_Width - 1 + m_CellSize - 1) / m_CellSize);
+    m_BaseY = std::max(1, (m_Height - 1 + m_CellSize - 1) / m_CellSize);
+
+    m_Levels.clear();
+    for (int l = 0;; ++l)
+    {
+        m_Levels.emplace_back(static_cast<size_t>(LevelWidth(l)) * LevelHeight(l));
+        if (LevelWidth(l) == 1 && LevelHeight(l) == 1) break;
+    }
+}
+
+inline void HeightPyramid::BuildLevels()
+{
+    for (int l = 1; l < LevelCount(); ++l)
+    {
+        const auto& src = m_Levels[l - 1];
+        auto& dst = m_Levels[l];
+        const int sw = LevelWidth(l - 1);
+        const int sh = LevelHeight(l - 1);
+        const int dw = LevelWidth(l);
+        const int dh = LevelHeight(l);
+        ParallelFor(0, dh, ParallelGrain(dh), [&](const int y0, const int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = 0; x < dw; ++x)
+                {
+                    uint16_t lo = std::numeric_limits<uint16_t>::max();
+                    uint16_t hi = 0;
+                    uint32_t sum = 0;
+                    uint32_t n = 0;
+                    for (int sy = y * 2; sy < std::min(y * 2 + 2, sh); ++sy)
+                    {
+                        for (int sx = x * 2; sx < std::min(x * 2 + 2, sw); ++sx)
+                        {
+                            const auto& c = src[sy * sw + sx];
+                            lo = std::min(lo, c.Min);
+                            hi = std::max(hi, c.Max);
+                            sum += c.Mean;
+                            ++n;
+                        }
+                    }
+                    dst[y * dw + x] = { lo, hi, static_cast<uint16_t>(sum / n) };
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,256 @@
+#include "HeightStore.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "Parallel.h"
+#include "PngReader.h"
+#include "stb_image.h"
+
+namespace
+{
+    // The rows of an image top to bottom as one gray channel, converted the way stb_image converts them so
+    // a streamed map has the samples a loaded one has. PNGs are streamed, anything else is loaded whole.
+    class GrayRows
+    {
+    public:
+        GrayRows(const std::filesystem::path& path, const bool sixteenBit) :
+            m_SixteenBit(sixteenBit), m_Png(PngReader::Open(path))
+        {
+            if (m_Png)
+            {
+                m_Width = m_Png->Width();
+                m_Height = m_Png->Height();
+                return;
+            }
+
+            int c;
+            m_Whole.reset(sixteenBit
+                ? static_cast<void*>(stbi_load_16(path.u8string().c_str(), &m_Width, &m_Height, &c, 1))
+                : static_cast<void*>(stbi_load(path.u8string().c_str(), &m_Width, &m_Height, &c, 1)));
+            if (!m_Whole)
+                throw std::runtime_error("failed to load " + path.u8string());
+        }
+
+        [[nodiscard]] int Width() const { return m_Width; }
+        [[nodiscard]] int Height() const { return m_Height; }
+
+        // the next row, 0 - 65535 for sixteen bits, 0 - 255 otherwise
+        void Next(uint16_t* out)
+        {
+            if (!m_Png)
+            {
+                const size_t at = static_cast<size_t>(m_Y++) * m_Width;
+                for (int x = 0; x < m_Width; ++x)
+                    out[x] = m_SixteenBit ? static_cast<const uint16_t*>(m_Whole.get())[at + x]
+                        : static_cast<const uint8_t*>(m_Whole.get())[at + x];
+                return;
+            }
+
+            const uint8_t* row = m_Png->ReadRow();
+            const int channels = m_Png->Channels();
+            const bool wide = m_Png->BitDepth() == 16;
+            const auto sample = [row, channels, wide](const int x, const int c)
+            {
+                const size_t i = static_cast<size_t>(x) * channels + c;
+                return wide ? row[2 * i] << 8 | row[2 * i + 1] : static_cast<int>(row[i]);
+            };
+            for (int x = 0; x < m_Width; ++x)
+            {
+                // stb_image's luminance, alpha dropped, in the source's depth before it changes depth
+                const int v = channels < 3 ? sample(x, 0)
+                    : (sample(x, 0) * 77 + sample(x, 1) * 150 + sample(x, 2) * 29) >> 8;
+                if (m_SixteenBit)
+                    out[x] = static_cast<uint16_t>(wide ? v : v * 257);
+                else
+                    out[x] = static_cast<uint16_t>(wide ? v >> 8 : v);
+            }
+        }
+
+    private:
+        const bool m_SixteenBit;
+        std::unique_ptr<PngReader> m_Png;
+        std::unique_ptr<void, decltype(&std::free)> m_Whole { nullptr, &std::free };
+        int m_Width = 0;
+        int m_Height = 0;
+        int m_Y = 0;
+    };
+}
+
+HeightStore::HeightStore(std::filesystem::path source, const int patchSize) :
+    m_Source(std::move(source)), m_PatchSize(patchSize)
+{
+    int c;
+    if (!stbi_info(m_Source.u8string().c_str(), &m_Width, &m_Height, &c))
+    {
+        m_Width = 0;
+        m_Height = 0;
+    }
+    m_Grid = { m_Width / (patchSize - 1), m_Height / (patchSize - 1) };
+}
+
+HeightStore::~HeightStore()
+{
+    m_File.close();
+    std::error_code ec;
+    if (!m_Path.empty()) std::filesystem::remove(m_Path, ec);
+}
+
+size_t HeightStore::PatchBytes() const
+{
+    const size_t pixels = static_cast<size_t>(m_PatchSize) * m_PatchSize;
+    return pixels * sizeof(float) + (HasMask() ? pixels : 0);
+}
+
+void HeightStore::Build(const std::filesystem::path& path, const int rowBegin, const int rowEnd)
+{
+    if (rowBegin < 0 || rowEnd > m_Grid.y || rowBegin > rowEnd)
+        throw std::runtime_error("height store rows out of range");
+
+    GrayRows heights(m_Source, true);
+    if (heights.Width() != m_Width || heights.Height() != m_Height)
+        throw std::runtime_error(m_Source.u8string() + " changed size");
+    std::unique_ptr<GrayRows> maskRows = nullptr;
+    if (!m_MaskImage.empty())
+    {
+        maskRows = std::make_unique<GrayRows>(m_MaskImage, false);
+        if (maskRows->Width() != m_Width || maskRows->Height() != m_Height)
+            throw std::runtime_error("mask " + m_MaskImage + " is not " + std::to_string(m_Width) + " x " +
+                std::to_string(m_Height));
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("failed to open " + path.u8string());
+
+    // A band is one patch row, patchSize rows of the source; the last row is shared with the next band and
+    // carried over. Only the pyramid, built when every row is stored, reads on to the bottom of the source.
+    const int n = m_PatchSize;
+    const int s = n - 1;
+    const int w = m_Width;
+    std::unique_ptr<HeightPyramid> pyramid = nullptr;
+    if (rowBegin == 0 && rowEnd == m_Grid.y)
+        pyramid = std::make_unique<HeightPyramid>(m_Width, m_Height);
+
+    std::vector<float> band(static_cast<size_t>(n) * w);
+    std::vector<uint8_t> bandMask(HasMask() ? band.size() : 0);
+    std::vector<uint16_t> raw(w);
+    std::vector<uint16_t> rawMask(maskRows ? w : 0);
+    int read = 0;
+    int fed = 0;
+    const auto readRow = [&](const int into, const bool keep)
+    {
+        heights.Next(raw.data());
+        if (maskRows) maskRows->Next(rawMask.data());
+        ++read;
+        if (!keep) return;
+        float* row = band.data() + static_cast<size_t>(into) * w;
+        for (int x = 0; x < w; ++x)
+            row[x] = raw[x] * (1.f / 65535.f);
+        if (!HasMask()) return;
+        uint8_t* rowMask = bandMask.data() + static_cast<size_t>(into) * w;
+        for (int x = 0; x < w; ++x)
+        {
+            rowMask[x] = (maskRows && rawMask[x] == 0) || (m_SeaLevel >= 0.0f && row[x] <= m_SeaLevel);
+            m_MaskedCount += rowMask[x];
+        }
+    };
+    const auto addRows = [&](const int bandY, const int y1)
+    {
+        if (!pyramid) return;
+        pyramid->AddRows(fed, y1, [&band, bandY, w](const int x, const int y)
+        {
+            return band[static_cast<size_t>(y - bandY) * w + x];
+        });
+        fed = y1;
+    };
+
+    m_MaskedCount = 0;
+    while (read < rowBegin * s) readRow(0, false);
+    const size_t patchBytes = PatchBytes();
+    std::vector<char> patches(patchBytes * m_Grid.x);
+    for (int py = rowBegin; py < rowEnd; ++py)
+    {
+        const int bandY = py * s;
+        if (py > rowBegin)
+        {
+            std::copy_n(band.begin() + static_cast<size_t>(s) * w, w, band.begin());
+            if (HasMask()) std::copy_n(bandMask.begin() + static_cast<size_t>(s) * w, w, bandMask.begin());
+        }
+        for (int r = py > rowBegin ? 1 : 0; r < n; ++r) readRow(r, true);
+        addRows(bandY, bandY + n);
+
+        ParallelFor(0, m_Grid.x, 1, [&](const int x0, const int x1)
+        {
+            for (int px = x0; px < x1; ++px)
+            {
+                char* patch = patches.data() + patchBytes * px;
+                auto* data = reinterpret_cast<float*>(patch);
+                auto* mask = reinterpret_cast<uint8_t*>(patch + static_cast<size_t>(n) * n * sizeof(float));
+                for (int r = 0; r < n; ++r)
+                {
+                    const size_t at = static_cast<size_t>(r) * w + static_cast<size_t>(px) * s;
+                    std::copy_n(band.begin() + at, n, data + r * n);
+                    if (HasMask()) std::copy_n(bandMask.begin() + at, n, mask + r * n);
+                }
+            }
+        });
+        out.write(patches.data(), static_cast<std::streamsize>(patches.size()));
+    }
+
+    // rows below the last patch row, a band at a time, for the pyramid and the masked count alone
+    while (pyramid && read < m_Height)
+    {
+        const int bandY = read;
+        const int rows = std::min(n, m_Height - read);
+        for (int r = 0; r < rows; ++r) readRow(r, true);
+        addRows(bandY, bandY + rows);
+    }
+
+    out.close();
+    if (!out)
+        throw std::runtime_error("failed to write " + path.u8string());
+
+    std::lock_guard lock(m_Mutex);
+    m_Path = path;
+    m_RowBegin = rowBegin;
+    m_RowEnd = rowEnd;
+    m_Pyramid = std::move(pyramid);
+    m_File.close();
+    m_File.open(path, std::ios::binary | std::ios::in);
+    if (!m_File)
+        throw std::runtime_error("failed to open " + path.u8string());
+    m_Patches.assign(static_cast<size_t>(rowEnd - rowBegin) * m_Grid.x, {});
+}
+
+std::shared_ptr<const Heightmap> HeightStore::Patch(const int x, const int y) const
+{
+    if (x < 0 || x >= m_Grid.x || y < m_RowBegin || y >= m_RowEnd)
+        throw std::runtime_error("patch " + std::to_string(x) + "_" + std::to_string(y) + " is not stored");
+
+    const size_t index = static_cast<size_t>(y - m_RowBegin) * m_Grid.x + x;
+    std::lock_guard lock(m_Mutex);
+    if (auto patch = m_Patches[index].lock()) return patch;
+
+    const size_t pixels = static_cast<size_t>(m_PatchSize) * m_PatchSize;
+    std::vector<float> data(pixels);
+    m_File.seekg(static_cast<std::streamoff>(index * PatchBytes()));
+    m_File.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(pixels * sizeof(float)));
+    auto patch = std::make_shared<Heightmap>(m_PatchSize, m_PatchSize, data);
+    if (HasMask())
+    {
+        std::vector<uint8_t> mask(pixels);
+        m_File.read(reinterpret_cast<char*>(mask.data()), static_cast<std::streamsize>(pixels));
+        patch->m_Mask = std::move(mask);
+    }
+    if (!m_File)
+        throw std::runtime_error("failed to read " + m_Path.u8string());
+    if (m_Pyramid)
+    {
+        patch->m_Pyramid = m_Pyramid;
+        patch->m_PyramidOrigin = glm::ivec2(x, y) * (m_PatchSize - 1);
+    }
+    m_Patches[index] = patch;
+    return patch;
+}
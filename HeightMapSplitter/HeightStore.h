@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "heightmap.h"
+#include "HeightPyramid.h"
+
+// The heightmap as the mesh stage reads it, cut into patches in a scratch file. Build() streams the source
+// image through once, a band of one patch row at a time, applies the mask, writes every patch of the band
+// with its mask next to it and feeds the pyramid. Patch() reads a patch back and shares it with everyone
+// holding it at the same time, so only the patches tasks hold are in memory: the wavefront's diagonals and
+// the neighbours around them, never the map. The scratch file goes with the store.
+class HeightStore
+{
+public:
+    // reads the size of source only, 0 x 0 when it is no image; patches of patchSize pixels share their borders
+    HeightStore(std::filesystem::path source, int patchSize);
+    ~HeightStore();
+
+    HeightStore(const HeightStore&) = delete;
+    HeightStore& operator=(const HeightStore&) = delete;
+
+    // masks the black pixels of an 8 bit image the size of the source, applied by Build()
+    void MaskImage(const std::string& path) { m_MaskImage = path; }
+
+    // masks every pixel at or below level, the sea, applied by Build()
+    void MaskBelow(const float level) { m_SeaLevel = level; }
+
+    [[nodiscard]] bool HasMask() const { return !m_MaskImage.empty() || m_SeaLevel >= 0.0f; }
+
+    [[nodiscard]] int Width() const { return m_Width; }
+    [[nodiscard]] int Height() const { return m_Height; }
+    [[nodiscard]] glm::ivec2 Grid() const { return m_Grid; }
+
+    // Streams patch rows [rowBegin, rowEnd) into path. All of them also build the pyramid over the whole
+    // source, the rows below the last patch row included, the extent the viewer's tiles have.
+    void Build(const std::filesystem::path& path, int rowBegin, int rowEnd);
+
+    // masked pixels of the rows read, once built
+    [[nodiscard]] size_t MaskedCount() const { return m_MaskedCount; }
+
+    // null unless every row was built
+    [[nodiscard]] std::shared_ptr<const HeightPyramid> Pyramid() const { return m_Pyramid; }
+
+    // Patch (x, y) of the built rows, with its mask and its place in the pyramid. Thread safe, a patch
+    // somebody still holds is handed out again instead of read twice.
+    [[nodiscard]] std::shared_ptr<const Heightmap> Patch(int x, int y) const;
+
+private:
+    [[nodiscard]] size_t PatchBytes() const;
+
+    const std::filesystem::path m_Source;
+    const int m_PatchSize;
+    int m_Width = 0;
+    int m_Height = 0;
+    glm::ivec2 m_Grid { 0 };
+    std::string m_MaskImage;
+    float m_SeaLevel = -1.0f;
+
+    std::filesystem::path m_Path;
+    int m_RowBegin = 0;
+    int m_RowEnd = 0;
+    size_t m_MaskedCount = 0;
+    std::shared_ptr<const HeightPyramid> m_Pyramid = nullptr;
+
+    mutable std::ifstream m_File;
+    mutable std::vector<std::weak_ptr<const Heightmap>> m_Patches;   // of the built rows, row major
+    mutable std::mutex m_Mutex;
+};
@@ -0,0 +1,179 @@
+#include "HlodBuilder.h"
+
+#include <algorithm>
+#include <meshoptimizer.h>
+#include <unordered_map>
+
+#include "Parallel.h"
+
+namespace
+{
+    constexpr int PatchSize = 255;
+}
+
+HlodBuilder::HlodBuilder(HeightSource heights, const float heightScale) :
+    m_Heights(std::move(heights)), m_HeightScale(heightScale)
+{
+}
+
+std::vector<Triangulator::PackedMesh> HlodBuilder::Run(BoundTree& tree, const PatchSource& source) const
+{
+    // internal nodes grouped by height above the leaves, so every group only reads finished children
+    std::vector<std::vector<BoundTree::Node*>> groups;
+    std::function<int(BoundTree::Node*)> collect = [&](BoundTree::Node* node) -> int
+    {
+        int height = 0;
+        bool leaf = true;
+        for (const auto& child : node->m_Children)
+        {
+            if (!child) continue;
+            leaf = false;
+            height = std::max(height, collect(child.get()) + 1);
+        }
+        if (leaf) return 0;
+        if (groups.size() < static_cast<size_t>(height)) groups.resize(height);
+        groups[height - 1].push_back(node);
+        return height;
+    };
+    if (!tree.m_Root) return {};
+    collect(tree.m_Root.get());
+
+    int count = 0;
+    for (auto& group : groups)
+        for (auto* node : group)
+            node->m_Bound.HlodIdx = count++;
+
+    std::vector<Mesh> merged(count);
+    std::vector<Triangulator::PackedMesh> meshes(count);
+    for (const auto& group : groups)
+    {
+        const int n = static_cast<int>(group.size());
+        ParallelFor(0, n, 1, [&](const int begin, const int end)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                const auto* node = group[i];
+                std::vector<Mesh> leaves;
+                std::vector<const Mesh*> children;
+                leaves.reserve(4);
+                for (const auto& child : node->m_Children)
+                {
+                    if (!child) continue;
+                    const auto& b = child->m_Bound;
+                    if (b.HlodIdx >= 0)
+                    {
+                        children.push_back(&merged[b.HlodIdx]);
+                        continue;
+                    }
+                    // fully masked, nothing to merge
+                    if (b.PatchIdx < 0) continue;
+                    // a leaf patch, lifted from patch local to global pixels
+                    const auto patch = source(b.AreaX, b.AreaY);
+                    const auto heights = m_Heights(b.AreaX, b.AreaY);
+                    Mesh& leaf = leaves.emplace_back();
+                    leaf.Points.reserve(patch.first.size());
+                    leaf.Heights.reserve(patch.first.size());
+                    for (const auto& p : patch.first)
+                    {
+                        leaf.Points.emplace_back(b.AreaX * PatchSize + p.PosX, b.AreaY * PatchSize + p.PosY);
+                        leaf.Heights.push_back(heights->At(p.PosX, p.PosY));
+                    }
+                    leaf.Indices = patch.second;
+                    children.push_back(&leaf);
+                }
+
+                const auto& bound = node->m_Bound;
+                auto& mesh = merged[bound.HlodIdx] = Merge(bound, children);
+
+                const int level = BoundTree::HlodLevel(bound);
+                const glm::ivec2 origin(bound.AreaX * PatchSize, bound.AreaY * PatchSize);
+                auto& [vertices, indices] = meshes[bound.HlodIdx];
+                vertices.reserve(mesh.Points.size());
+                for (const auto& p : mesh.Points)
+                    vertices.emplace_back(static_cast<uint8_t>((p.x - origin.x) >> level),
+                        static_cast<uint8_t>((p.y - origin.y) >> level));
+                indices = mesh.Indices;
+            }
+        });
+
+        // the children of this group are no longer needed
+        for (const auto* node : group)
+            for (const auto& child : node->m_Children)
+                if (child && child->m_Bound.HlodIdx >= 0)
+                    merged[child->m_Bound.HlodIdx] = Mesh();
+    }
+    return meshes;
+}
+
+HlodBuilder::Mesh HlodBuilder::Merge(const BoundTree::Bound& bound, const std::vector<const Mesh*>& children) const
+{
+    const int level = BoundTree::HlodLevel(bound);
+    const int step = 1 << level;
+    const glm::ivec2 origin(bound.AreaX * PatchSize, bound.AreaY * PatchSize);
+
+    // Snap onto the node grid and weld, rivets made the children's seam vertices coincide already. A snapped
+    // point keeps the height of the first vertex welded onto it, less than a grid step away; the heights only
+    // steer the simplifier, the viewer displaces with its own height texture.
+    Mesh mesh;
+    std::unordered_map<uint64_t, uint32_t> welded;
+    size_t sourceIndices = 0;
+    for (const auto* child : children)
+    {
+        std::vector<uint32_t> remap(child->Points.size());
+        for (size_t i = 0; i < child->Points.size(); ++i)
+        {
+            const glm::ivec2 local = child->Points[i] - origin;
+            const glm::ivec2 p(origin.x + (local.x + step / 2) / step * step,
+                origin.y + (local.y + step / 2) / step * step);
+            const uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(p.x)) << 32 | static_cast<uint32_t>(p.y);
+            const auto [it, inserted] = welded.emplace(key, static_cast<uint32_t>(mesh.Points.size()));
+            if (inserted)
+            {
+                mesh.Points.push_back(p);
+                mesh.Heights.push_back(child->Heights[i]);
+            }
+            remap[i] = it->second;
+        }
+        for (size_t t = 0; t + 2 < child->Indices.size(); t += 3)
+        {
+            const uint32_t a = remap[child->Indices[t]];
+            const uint32_t b = remap[child->Indices[t + 1]];
+            const uint32_t c = remap[child->Indices[t + 2]];
+            if (a == b || b == c || c == a) continue;
+            mesh.Indices.insert(mesh.Indices.end(), { a, b, c });
+        }
+        sourceIndices += child->Indices.size();
+    }
+    if (mesh.Indices.empty()) return mesh;
+
+    std::vector<float> positions(mesh.Points.size() * 3);
+    for (size_t i = 0; i < mesh.Points.size(); ++i)
+    {
+        const auto& p = mesh.Points[i];
+        positions[i * 3 + 0] = static_cast<float>(p.x);
+        positions[i * 3 + 1] = mesh.Heights[i] * m_HeightScale;
+        positions[i * 3 + 2] = static_cast<float>(p.y);
+    }
+
+    // back down to the budget of one child, the triangle count stays flat across levels
+    const size_t target = std::max<size_t>(sourceIndices / std::max<size_t>(children.size(), 1) / 3 * 3, 3);
+    std::vector<uint32_t> simplified(mesh.Indices.size());
+    simplified.resize(meshopt_simplify(simplified.data(), mesh.Indices.data(), mesh.Indices.size(),
+        positions.data(), mesh.Points.size(), sizeof(float) * 3, target, 1.0f, meshopt_SimplifyLockBorder, nullptr));
+    mesh.Indices = std::move(simplified);
+
+    // only what the simplified triangles still use goes on, into the parent's weld and into the archive
+    std::vector<uint32_t> remap(mesh.Points.size());
+    const size_t used = meshopt_optimizeVertexFetchRemap(remap.data(), mesh.Indices.data(), mesh.Indices.size(),
+        mesh.Points.size());
+    meshopt_remapIndexBuffer(mesh.Indices.data(), mesh.Indices.data(), mesh.Indices.size(), remap.data());
+    std::vector<glm::ivec2> points(mesh.Points.size());
+    std::vector<float> heights(mesh.Heights.size());
+    meshopt_remapVertexBuffer(points.data(), mesh.Points.data(), mesh.Points.size(), sizeof(glm::ivec2), remap.data());
+    meshopt_remapVertexBuffer(heights.data(), mesh.Heights.data(), mesh.Heights.size(), sizeof(float), remap.data());
+    points.resize(used);
+    heights.resize(used);
+    mesh.Points = std::move(points);
+    mesh.Heights = std::move(heights);
+    return mesh;
+}
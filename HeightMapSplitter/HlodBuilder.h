@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "BoundTree.h"
+#include "heightmap.h"
+#include "triangulator.h"
+
+// Far field meshes for the internal nodes of a BoundTree. A node merges the meshes of its children,
+// the patches' coarsest LOD at the bottom, welds the former seams, snaps to its own 2^level grid and
+// simplifies back down to about one patch worth of triangles, so a far node costs one draw. The outer
+// border of every node is locked, only the seams inside it move.
+class HlodBuilder
+{
+public:
+    // the coarse mesh of patch (x, y) in patch local pixels
+    using PatchSource = std::function<Triangulator::PackedMesh(int x, int y)>;
+    // the heights of patch (x, y), only read while its mesh is lifted into a leaf
+    using HeightSource = std::function<std::shared_ptr<const Heightmap>(int x, int y)>;
+
+    HlodBuilder(HeightSource heights, float heightScale);
+
+    // Builds every internal node bottom up, numbers them into Bound::HlodIdx and returns the meshes by
+    // that index, in node space: positions in 2^BoundTree::HlodLevel() pixels from the node's corner.
+    std::vector<Triangulator::PackedMesh> Run(BoundTree& tree, const PatchSource& source) const;
+
+private:
+    // in global pixels, with the normalized height of every point
+    struct Mesh
+    {
+        std::vector<glm::ivec2> Points;
+        std::vector<float> Heights;
+        std::vector<uint32_t> Indices;
+    };
+
+    Mesh Merge(const BoundTree::Bound& bound, const std::vector<const Mesh*>& children) const;
+
+    const HeightSource m_Heights;
+    const float m_HeightScale;
+};
@@ -0,0 +1,173 @@
+#include "HorizonBaker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <DirectXTex.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <stdexcept>
+
+#include "heightmap.h"
+#include "Parallel.h"
+#include "TileLayout.h"
+
+namespace
+{
+    void SaveR8(const std::filesystem::path& path, const std::vector<uint8_t>& data, const int w, const int h)
+    {
+        DirectX::Image img {};
+        img.width = w;
+        img.height = h;
+        img.format = DXGI_FORMAT_R8_UNORM;
+        img.rowPitch = w;
+        img.slicePitch = data.size();
+        img.pixels = const_cast<uint8_t*>(data.data());
+        if (FAILED(SaveToDDSFile(img, DirectX::DDS_FLAGS_NONE, path.wstring().c_str())))
+            throw std::runtime_error("failed to save " + path.u8string());
+    }
+}
+
+HorizonBaker::HorizonBaker(const Heightmap& heightmap, const float zScale, const int directionCount) :
+    m_Heightmap(heightmap), m_ZScale(zScale), m_DirectionCount(directionCount)
+{
+    if (directionCount <= 0 || directionCount % 4 != 0)
+        throw std::runtime_error("horizon direction count must be a multiple of 4");
+}
+
+void HorizonBaker::Run(const std::filesystem::path& outDir)
+{
+    const int w = m_Heightmap.Width();
+    const int h = m_Heightmap.Height();
+    m_Ao.assign(static_cast<size_t>(w) * h, 0.0f);
+
+    std::vector<uint32_t> packed(static_cast<size_t>(w) * h);
+    for (int group = 0; group < m_DirectionCount / 4; ++group)
+    {
+        for (int c = 0; c < 4; ++c)
+            Sweep(group * 4 + c, reinterpret_cast<uint8_t*>(packed.data()) + c);
+
+        DirectX::Image img {};
+        img.width = w;
+        img.height = h;
+        img.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        img.rowPitch = w * sizeof(uint32_t);
+        img.slicePitch = packed.size() * sizeof(uint32_t);
+        img.pixels = reinterpret_cast<uint8_t*>(packed.data());
+        const auto path = outDir / ("horizon" + std::to_string(group) + ".dds");
+        if (FAILED(SaveToDDSFile(img, DirectX::DDS_FLAGS_NONE, path.wstring().c_str())))
+            throw std::runtime_error("failed to save " + path.u8string());
+        std::printf("%s generated\n", path.u8string().c_str());
+    }
+}
+
+void HorizonBaker::Sweep(const int direction, uint8_t* horizon)
+{
+    const int w = m_Heightmap.Width();
+    const int h = m_Heightmap.Height();
+    const float phi = glm::two_pi<float>() * direction / m_DirectionCount;
+    const float dx = std::cos(phi);
+    const float dy = std::sin(phi);
+
+    // march one pixel per step along the major axis, the minor axis follows with |slope| <= 1
+    const bool xMajor = std::abs(dx) >= std::abs(dy);
+    const int major = xMajor ? w : h;
+    const int minor = xMajor ? h : w;
+    const float dMajor = xMajor ? dx : dy;
+    const float dMinor = xMajor ? dy : dx;
+    const float slope = -dMinor / std::abs(dMajor);     // minor offset per step, walking against the direction
+    const float step = std::sqrt(1.0f + slope * slope); // distance per step
+
+    // lines start at integer minor offsets, rounding then hits every pixel of a column exactly once
+    const int travel = static_cast<int>(std::ceil(std::abs(slope) * (major - 1)));
+    const int lineBegin = slope > 0.0f ? -travel : 0;
+    const int lineEnd = minor + (slope < 0.0f ? travel : 0);
+
+    // lines along rows are already contiguous, column-major lines are swept in lockstep bundles
+    // so each step touches adjacent pixels instead of one row per line
+    constexpr int MaxBundle = 128;
+    const int bundleSize = xMajor ? 1 : MaxBundle;
+    const int bundleCount = (lineEnd - lineBegin + bundleSize - 1) / bundleSize;
+    const float weight = 1.0f / m_DirectionCount;
+    const float zScale = m_ZScale;
+    const float* heights = m_Heightmap.m_Data.data();
+    float* ao = m_Ao.data();
+    ParallelFor(0, bundleCount, ParallelGrain(bundleCount), [=](const int b0, const int b1)
+    {
+        std::vector<glm::vec2> hulls[MaxBundle];
+        for (int bundle = b0; bundle < b1; ++bundle)
+        {
+            const int first = lineBegin + bundle * bundleSize;
+            const int count = std::min(bundleSize, lineEnd - first);
+            for (auto& hull : hulls)
+                hull.clear();
+            for (int k = 0; k < major; ++k)
+            {
+                const int m = dMajor > 0.0f ? major - 1 - k : k;
+                const int base = static_cast<int>(std::floor(first + k * slope + 0.5f));
+                for (int l = 0; l < count; ++l)
+                {
+                    // lines start at integer offsets, so they all share the same rounding
+                    const int n = base + l;
+                    if (n < 0 || n >= minor) continue;
+
+                    const int x = xMajor ? m : n;
+                    const int y = xMajor ? n : m;
+                    const size_t i = static_cast<size_t>(y) * w + x;
+                    const glm::vec2 p(k * step, heights[i] * zScale);
+
+                    auto& hull = hulls[l];
+                    // pop while the older point sees over the newer one, compared without dividing
+                    while (hull.size() >= 2)
+                    {
+                        const auto& a = hull[hull.size() - 2];
+                        const auto& b = hull.back();
+                        if ((a.y - p.y) * (p.x - b.x) < (b.y - p.y) * (p.x - a.x)) break;
+                        hull.pop_back();
+                    }
+                    const float t = hull.empty()
+                                        ? 0.0f
+                                        : std::max((hull.back().y - p.y) / (p.x - hull.back().x), 0.0f);
+                    hull.push_back(p);
+
+                    const float cos2 = 1.0f / (1.0f + t * t);
+                    horizon[i * 4] = static_cast<uint8_t>(std::sqrt(1.0f - cos2) * 255.0f + 0.5f);
+                    ao[i] += cos2 * weight;
+                }
+            }
+        }
+    });
+}
+
+void HorizonBaker::SaveAo(const std::filesystem::path& path) const
+{
+    std::vector<uint8_t> data(m_Ao.size());
+    std::transform(m_Ao.begin(), m_Ao.end(), data.begin(),
+        [](const float ao) { return static_cast<uint8_t>(std::clamp(ao, 0.0f, 1.0f) * 255.0f + 0.5f); });
+    SaveR8(path, data, m_Heightmap.Width(), m_Heightmap.Height());
+    std::printf("%s generated\n", path.u8string().c_str());
+}
+
+void HorizonBaker::SaveAoTiles(const std::filesystem::path& dir, const int tilesX, const int tilesY) const
+{
+    const int w = m_Heightmap.Width();
+    const TileLayout layout(w, m_Heightmap.Height(), tilesX, tilesY);
+    const int tw = layout.TileWidth;
+    const int th = layout.TileHeight;
+    std::vector<uint8_t> tile(static_cast<size_t>(tw) * th);
+    for (int ty = 0; ty < tilesY; ++ty)
+    {
+        for (int tx = 0; tx < tilesX; ++tx)
+        {
+            for (int y = 0; y < th; ++y)
+            {
+                const float* row = m_Ao.data() + static_cast<size_t>(layout.OriginY(ty) + y) * w + layout.OriginX(tx);
+                std::transform(row, row + tw, tile.begin() + static_cast<size_t>(y) * tw,
+                    [](const float ao) { return static_cast<uint8_t>(std::clamp(ao, 0.0f, 1.0f) * 255.0f + 0.5f); });
+            }
+            const auto path = dir / ("ao" + std::to_string(layout.Index(tx, ty)) + ".dds");
+            SaveR8(path, tile, tw, th);
+            std::printf("%s generated\n", path.u8string().c_str());
+        }
+    }
+}
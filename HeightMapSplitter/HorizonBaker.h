@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+class Heightmap;
+
+// Bakes per-pixel horizon angles for a set of azimuths with a line sweep.
+// Each direction is rasterized into parallel lines that cover every pixel exactly once; walking a line
+// against the direction keeps the upper convex hull of the terrain already passed, so the horizon of the
+// next pixel is its tangent to the hull and the whole direction costs O(pixels).
+// Lines of one direction run in parallel, directions run one after another.
+class HorizonBaker
+{
+public:
+    HorizonBaker(const Heightmap& heightmap, float zScale, int directionCount = 16);
+
+    // Writes horizon<g>.dds for each group g of 4 azimuths, channel c holds azimuth 4g + c
+    // (counter-clockwise from +x) as sin(elevation) in RGBA8, so a sun at that azimuth is visible
+    // when its sin(elevation) is above the stored value. Only one packed group is held at a time.
+    void Run(const std::filesystem::path& outDir);
+
+    // Cosine weighted sky visibility, mean of cos^2(horizon) over all azimuths.
+    [[nodiscard]] const std::vector<float>& Ao() const { return m_Ao; }
+
+    void SaveAo(const std::filesystem::path& path) const;
+
+    // Splits the AO into tilesX x tilesY maps ao<i>.dds on the TileLayout the source tiles use, so ao<i> lines
+    // up with height<i> and normal<i>.
+    void SaveAoTiles(const std::filesystem::path& dir, int tilesX, int tilesY) const;
+
+private:
+    void Sweep(int direction, uint8_t* horizon);
+
+    const Heightmap& m_Heightmap;
+    const float m_ZScale;
+    const int m_DirectionCount;
+    std::vector<float> m_Ao {};
+};
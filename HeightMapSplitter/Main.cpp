@@ -3,19 +3,36 @@
 // Read online: https://github.com/ocornut/imgui/tree/master/docs
 
 #define NOMINMAX
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
 
+#include "AsyncWriter.h"
+#include "BuildCache.h"
+#include "BuildReport.h"
+#include "ClusterBuilder.h"
 #include "heightmap.h"
+#include "HeightStore.h"
+#include "PatchArchive.h"
+#include "HlodBuilder.h"
+#include "MeshAnalyzer.h"
+#include "MeshValidator.h"
+#include "HorizonBaker.h"
+#include "Parallel.h"
+#include "ShardPlan.h"
+#include "SourceTiler.h"
+#include "SplatBaker.h"
 #include "stl.h"
+#include "TaskGraph.h"
 #include "ThreadPool.h"
 #include "Triangulator.h"
 
 #include <meshoptimizer.h>
 #include <regex>
-#include <unordered_set>
+#include <xsimd/xsimd.hpp>
 
 #include "BoundTree.h"
 #include "SideCutter.h"
@@ -24,17 +41,24 @@
 #define GENERATE_STL
 
 ThreadPool g_ThreadPool(std::thread::hardware_concurrency());
+AsyncWriter g_Writer;
 
+// queues one bulk write on the writer thread, the caller's buffer is copied and free to go
 template <typename T>
 void SaveBin(const std::filesystem::path& path, const std::vector<T>& data)
 {
-    std::ofstream ofs(path, std::ios::binary | std::ios::out);
-    if (!ofs)
+    g_Writer.Write(path, data);
+}
+
+template <typename T>
+std::vector<T> LoadBin(const std::filesystem::path& path)
+{
+    std::ifstream ifs(path, std::ios::binary | std::ios::in);
+    if (!ifs)
         throw std::runtime_error("failed to open " + path.u8string());
-    for (const auto& v : data)
-        ofs.write(reinterpret_cast<const char*>(&v), sizeof(T));
-    ofs.close();
-    std::printf("%s generated\n", path.u8string().c_str());
+    std::vector<T> data(file_size(path) / sizeof(T));
+    ifs.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
+    return data;
 }
 
 auto OptimizeMeshCache(std::vector<Triangulator::PackedPoint>& vertices, std::vector<uint32_t>& indices)
@@ -111,6 +135,74 @@ void SaveErrorStatics(const std::map<float, int>& m)
     std::cout << "error.json generated" << std::endl;
 }
 
+// Triangles a patch needs for its finest LOD. A linear triangle strays from a curved surface by its size
+// squared times the curvature, so the triangle count grows with the summed Laplacian over the error,
+// whichever of the smooth and the pixel scale one is larger.
+double PredictTriangles(const Heightmap::Roughness& roughness, const float finestError)
+{
+    if (roughness.Range <= finestError) return 2.0;
+    return std::min(2.0 + std::max(roughness.Laplacian, roughness.Detail) / finestError, 2.0 * 255 * 255);
+}
+
+// pixels between the samples a preview triangulates, 255 = 5 * 51 keeps every patch border on the grid
+constexpr int PreviewStep = 5;
+
+// The coarsest LOD of a patch triangulated from every PreviewStep-th pixel, in the patch's own pixels.
+// Neighbours sample their shared border the same way, so the rivets and the cut still close the seams.
+Triangulator::PackedMesh TriangulatePreview(const Heightmap& patch, const float error)
+{
+    const int n = (patch.Width() - 1) / PreviewStep + 1;
+    std::vector<float> samples(static_cast<size_t>(n) * n);
+    std::vector<uint8_t> mask(patch.HasMask() ? samples.size() : 0);
+    for (int y = 0; y < n; ++y)
+    {
+        for (int x = 0; x < n; ++x)
+        {
+            samples[static_cast<size_t>(y) * n + x] = patch.At(x * PreviewStep, y * PreviewStep);
+            if (!mask.empty())
+                mask[static_cast<size_t>(y) * n + x] = patch.Masked(x * PreviewStep, y * PreviewStep);
+        }
+    }
+
+    const auto sampled = std::make_shared<Heightmap>(n, n, samples);
+    sampled->SetMask(std::move(mask));
+    Triangulator tri(sampled, 0, 131072, 65536);
+    tri.Initialize();
+    auto mesh = std::move(tri.RunLod(Triangulator::ErrorHeap(std::less<>(), { error })).front());
+    for (auto& p : mesh.first)
+        p = Triangulator::PackedPoint(static_cast<uint8_t>(p.PosX * PreviewStep),
+            static_cast<uint8_t>(p.PosY * PreviewStep));
+    return mesh;
+}
+
+// Predicted against measured triangulation cost of every triangulated patch, with the least squares
+// seconds per predicted triangle and how well the two correlate, to calibrate PredictTriangles.
+void ReportCostModel(BuildReport& report, const std::vector<glm::ivec2>& patches,
+    const std::vector<std::vector<double>>& predicted, const std::vector<std::vector<double>>& seconds)
+{
+    double sp = 0.0, ss = 0.0, spp = 0.0, sss = 0.0, sps = 0.0;
+    for (const auto& p : patches)
+    {
+        const double cost = predicted[p.y][p.x];
+        const double time = seconds[p.y][p.x];
+        report.AddPatch(p.x, p.y, "predicted_triangles", cost);
+        report.AddPatch(p.x, p.y, "triangulate_seconds", time);
+        sp += cost;
+        ss += time;
+        spp += cost * cost;
+        sss += time * time;
+        sps += cost * time;
+    }
+    const auto n = static_cast<double>(patches.size());
+    const double variance = (n * spp - sp * sp) * (n * sss - ss * ss);
+    const double correlation = variance > 0.0 ? (n * sps - sp * ss) / std::sqrt(variance) : 0.0;
+    const double secondsPerTriangle = spp > 0.0 ? sps / spp : 0.0;
+    report.Add("cost_model_correlation", correlation);
+    report.Add("cost_model_seconds_per_triangle", secondsPerTriangle);
+    std::printf("cost model: correlation %.3f, %.3g seconds per predicted triangle\n", correlation,
+        secondsPerTriangle);
+}
+
 template <typename T>
 void MergeMesh(T& mesh, const T& other)
 {
@@ -220,7 +312,35 @@ void GenerateClipmapFootPrints(const std::filesystem::path& path, const int n =
         generateGrid(2 * m, 2, m - 1, 3 * (m - 1) + 1));
 }
 
-void CompositeNorAo(const std::filesystem::path& p)
+// Replaces the alpha byte of count RGBA8 pixels with alpha[i], the bytes widen into 32 bit lanes in the load.
+void PackAlpha(uint32_t* rgba, const uint8_t* alpha, const size_t count)
+{
+    using Batch = xsimd::batch<uint32_t, xsimd::default_arch>;
+    constexpr size_t n = Batch::size;
+    size_t i = 0;
+    for (; i + n <= count; i += n)
+    {
+        const Batch color = Batch::load_unaligned(rgba + i);
+        const Batch a = Batch::load_unaligned(alpha + i);
+        ((color & Batch(0xffffffu)) | (a << 24)).store_unaligned(rgba + i);
+    }
+    for (; i < count; ++i)
+        rgba[i] = rgba[i] & 0xffffff | static_cast<uint32_t>(alpha[i]) << 24;
+}
+
+// packs an R8 image into the alpha of an RGBA8 image of the same size, in row bands on the pool
+void PackAlpha(const DirectX::Image& rgba, const DirectX::Image& alpha)
+{
+    const int h = static_cast<int>(rgba.height);
+    ParallelFor(0, h, ParallelGrain(h), [&rgba, &alpha](const int begin, const int end)
+    {
+        for (int y = begin; y < end; ++y)
+            PackAlpha(reinterpret_cast<uint32_t*>(rgba.pixels + y * rgba.rowPitch), alpha.pixels + y * alpha.rowPitch,
+                rgba.width);
+    });
+}
+
+void CompositeNorAo(const std::filesystem::path& p, const BuildCache& cache)
 {
     if (!is_directory(p)) return;
 
@@ -236,6 +356,13 @@ void CompositeNorAo(const std::filesystem::path& p)
     }
 
     if (nmPath.empty() || aoPath.empty()) return;
+    const auto key = ContentHash().Add("normal ao 1").AddFile(nmPath).AddFile(aoPath).Value();
+    if (cache.Restore(key, p))
+    {
+        std::printf("composite %s normal (cached)\n", p.u8string().c_str());
+        return;
+    }
+
     const auto nm = LoadWic(nmPath, true, false);
     const auto ao = LoadWic(aoPath, false, false);
     if (nm->GetMetadata().width != ao->GetMetadata().width ||
@@ -247,27 +374,16 @@ void CompositeNorAo(const std::filesystem::path& p)
         return;
     }
 
-    const auto w = nm->GetMetadata().width;
-    const auto h = nm->GetMetadata().height;
-    const auto nmData = reinterpret_cast<uint32_t*>(nm->GetPixels());
-    const auto aoData = ao->GetPixels();
-    for (auto y = 0; y < h; ++y)
-    {
-        for (auto x = 0; x < w; ++x)
-        {
-            const auto i = y * w + x;
-            const auto a = aoData[i];
-            nmData[i] = nmData[i] & 0xffffff | a << 24;
-        }
-    }
+    PackAlpha(*nm->GetImage(0, 0, 0), *ao->GetImage(0, 0, 0));
 
     SaveDds(p / "normal.dds",
         *GenerateMip(*nm->GetImage(0, 0, 0), DirectX::TEX_FILTER_SEPARATE_ALPHA));
+    cache.Store(key, { p / "normal.dds" });
 
     std::printf("composite %s normal\n", p.u8string().c_str());
 }
 
-void CompositeAlbRf(const std::filesystem::path& p)
+void CompositeAlbRf(const std::filesystem::path& p, const BuildCache& cache)
 {
     if (!is_directory(p)) return;
 
@@ -283,6 +399,13 @@ void CompositeAlbRf(const std::filesystem::path& p)
     }
 
     if (amPath.empty() || rfPath.empty()) return;
+    const auto key = ContentHash().Add("albedo roughness 1").AddFile(amPath).AddFile(rfPath).Value();
+    if (cache.Restore(key, p))
+    {
+        std::printf("composite %s albedo (cached)\n", p.u8string().c_str());
+        return;
+    }
+
     const auto am = LoadWic(amPath, true, false);
     const auto rm = LoadWic(rfPath, false, false);
     if (am->GetMetadata().width != rm->GetMetadata().width ||
@@ -294,26 +417,15 @@ void CompositeAlbRf(const std::filesystem::path& p)
         return;
     }
 
-    const auto w = am->GetMetadata().width;
-    const auto h = am->GetMetadata().height;
-    const auto alData = reinterpret_cast<uint32_t*>(am->GetPixels());
-    const auto rfData = rm->GetPixels();
-    for (auto y = 0; y < h; ++y)
-    {
-        for (auto x = 0; x < w; ++x)
-        {
-            const auto i = y * w + x;
-            const auto a = rfData[i];
-            alData[i] = alData[i] & 0xffffff | a << 24;
-        }
-    }
+    PackAlpha(*am->GetImage(0, 0, 0), *rm->GetImage(0, 0, 0));
 
     SaveDds(p / "albedo.dds",
         *GenerateMip(*am->GetImage(0, 0, 0), DirectX::TEX_FILTER_SEPARATE_ALPHA));
+    cache.Store(key, { p / "albedo.dds" });
     std::printf("composite %s albedo\n", p.u8string().c_str());
 }
 
-void ConvertHeight(const std::filesystem::path& p)
+void ConvertHeight(const std::filesystem::path& p, const BuildCache& cache)
 {
     if (!is_directory(p)) return;
 
@@ -325,175 +437,924 @@ void ConvertHeight(const std::filesystem::path& p)
             hPath = entry.path();
     }
 
+    if (hPath.empty()) return;
+    const auto key = ContentHash().Add("height 1").AddFile(hPath).Value();
+    if (cache.Restore(key, p))
+    {
+        std::printf("convert %s height (cached)\n", p.u8string().c_str());
+        return;
+    }
+
     const auto hm = LoadWic(hPath, false, true);
     auto convert = std::make_shared<DirectX::ScratchImage>();
     DirectX::Convert(*hm->GetImage(0, 0, 0), DXGI_FORMAT_R32_UINT, DirectX::TEX_FILTER_DEFAULT,
         DirectX::TEX_THRESHOLD_DEFAULT, *convert);
     SaveDds(p / "height.dds", *hm);
+    cache.Store(key, { p / "height.dds" });
     std::printf("convert %s height\n", p.u8string().c_str());
 }
 
-// Main code
-int main(int argc, char** argv)
+struct BuildOptions
 {
-    if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+    std::string Input;
+    bool Textures = false;
+    bool Meshes = false;
+    bool Horizon = false;
+    bool Tiles = false;
+    bool Splat = false;
+    int TilesX = 2;
+    int TilesY = 2;
+    bool Cache = true;
+    bool CompressMeshes = true;
+    bool Trace = false;
+    ShardPlan Shard {};
+    int MergeShards = 0;    // shard count whose outputs to assemble, 0 when not merging
+    int PatchWindow = 0;    // triangulated patches holding their LODs at once, 0 picks one from the threads
+    bool Preview = false;
+    std::string Mask;       // image whose black pixels are no-data, empty when there is none
+    float SeaLevel = -1.0f; // pixels at or below it are water and masked too, negative when there is no sea
+};
+
+// world units per normalized height, the viewer's default height scale
+constexpr float HeightScale = 2129.92f;
+
+// HeightMapSplitter <heightmap> [options], no stage flag runs every stage
+//   --textures         clipmap footprints and the material textures in texture_can
+//   --meshes           the mesh stage: patches, archive, bounds and HLODs
+//   --horizon          horizon maps and ambient occlusion
+//   --tiles            height and normal source tiles
+//   --splat            splat source tiles, rules from splat_rules.json next to the heightmap when present
+//   --grid=NxM         source tile grid, 2x2 by default
+//   --no-cache         rebuilds every patch instead of restoring it from asset/cache
+//   --raw-meshes       leaves the archive uncompressed
+//   --trace            adds asset/build_trace.json for chrome://tracing next to asset/build_report.json
+//   --shard=I/N        cuts and saves band I of N of the patch rows and nothing else
+//   --merge=N          builds the archive, bounds, HLODs and error statistics once all N shards are done
+//   --window=N         patches holding their LODs at once, raised to the two diagonals the wavefront needs
+//   --preview          only the coarsest error from every PreviewStep-th pixel, saved as every LOD, unchecked
+//   --mask=<image>     black pixels are no-data
+//   --sea-level=H      pixels at or below H, in the heightmap's 0 ~ 1, are water and masked too
+// --shard, --merge and --preview default to the mesh stage alone. A preview skips the clusters, the GPU
+// analysis, the validation and the HLODs. Masked pixels do not count towards any error, triangles over nothing
+// else are left out and patches without any land get no meshes at all.
+BuildOptions ParseOptions(const int argc, char** argv)
+{
+    BuildOptions options;
+    for (int i = 1; i < argc; ++i)
     {
-        std::cerr << "failed to initialize COM" << std::endl;
-        return 1;
+        const std::string arg = argv[i];
+        if (arg == "--textures") options.Textures = true;
+        else if (arg == "--meshes") options.Meshes = true;
+        else if (arg == "--horizon") options.Horizon = true;
+        else if (arg == "--tiles") options.Tiles = true;
+        else if (arg == "--splat") options.Splat = true;
+        else if (arg == "--no-cache") options.Cache = false;
+        else if (arg == "--raw-meshes") options.CompressMeshes = false;
+        else if (arg == "--trace") options.Trace = true;
+        else if (arg == "--preview") options.Preview = true;
+        else if (arg.rfind("--grid=", 0) == 0)
+        {
+            if (std::sscanf(arg.c_str(), "--grid=%dx%d", &options.TilesX, &options.TilesY) != 2)
+                throw std::runtime_error("expected --grid=NxM");
+        }
+        else if (arg.rfind("--shard=", 0) == 0)
+        {
+            auto& shard = options.Shard;
+            if (std::sscanf(arg.c_str(), "--shard=%d/%d", &shard.Index, &shard.Count) != 2 ||
+                shard.Count <= 0 || shard.Index < 0 || shard.Index >= shard.Count)
+                throw std::runtime_error("expected --shard=I/N with 0 <= I < N");
+        }
+        else if (arg.rfind("--merge=", 0) == 0)
+        {
+            if (std::sscanf(arg.c_str(), "--merge=%d", &options.MergeShards) != 1 || options.MergeShards <= 0)
+                throw std::runtime_error("expected --merge=N");
+        }
+        else if (arg.rfind("--window=", 0) == 0)
+        {
+            if (std::sscanf(arg.c_str(), "--window=%d", &options.PatchWindow) != 1 || options.PatchWindow <= 0)
+                throw std::runtime_error("expected --window=N");
+        }
+        else if (arg.rfind("--mask=", 0) == 0) options.Mask = arg.substr(std::size("--mask=") - 1);
+        else if (arg.rfind("--sea-level=", 0) == 0)
+        {
+            if (std::sscanf(arg.c_str(), "--sea-level=%f", &options.SeaLevel) != 1 || options.SeaLevel < 0.0f)
+                throw std::runtime_error("expected --sea-level=H with H >= 0");
+        }
+        else if (arg.rfind("--", 0) == 0) throw std::runtime_error("unknown option " + arg);
+        else options.Input = arg;
     }
-    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    if (options.Shard.Count && options.MergeShards)
+        throw std::runtime_error("--shard and --merge are separate steps");
+    if (options.Preview && (options.Shard.Count || options.MergeShards))
+        throw std::runtime_error("--preview builds the whole world at once");
+    if (options.Preview) options.CompressMeshes = false;
+    if (!options.Textures && !options.Meshes && !options.Horizon && !options.Tiles && !options.Splat)
+    {
+        if (options.Shard.Count || options.MergeShards || options.Preview)
+            options.Meshes = true;
+        else
+            options.Textures = options.Meshes = options.Horizon = options.Tiles = options.Splat = true;
+    }
+    return options;
+}
 
-    if (argc < 2) return 1;
-    std::string inFile = argv[1];
-    const std::wstring parent = std::filesystem::path(inFile).parent_path().wstring();
+// the heap refines coarse to fine and RunLod hands the LODs back finest first, LodErrors[k] is what lod k
+// was built for, and what the archive, error.json and the validator label it with
+constexpr float LodErrors[] = { 0.0003293752670288086f, 0.00047141313552856445f, 0.0006998777389526367f };
+constexpr int LodCount = static_cast<int>(std::size(LodErrors));
+static_assert(LodErrors[0] < LodErrors[1] && LodErrors[1] < LodErrors[2], "lod 0 is the finest");
 
-    const auto clipmapPath = parent + L"/clipmap";
-    std::filesystem::create_directories(clipmapPath);
-    GenerateClipmapFootPrints(clipmapPath);
+using Clock = BuildReport::Clock;
 
-    for (auto&& dir : std::filesystem::directory_iterator(parent + L"\\texture_can"))
+// What the mesh stage knows of every patch before it builds any. A shard owns rows [RowBegin, RowEnd) and
+// treats every other row as done, the halo rows next to its band are still triangulated for their borders,
+// which come out the same as in the shard owning them. Merging owns no rows, it only archives what the
+// shards left in asset.
+struct PatchGrid
+{
+    int Nx = 0;
+    int Ny = 0;
+    int RowBegin = 0;
+    int RowEnd = 0;
+    ContentHash Params {};
+    std::vector<std::vector<char>> Masked {};           // no land at all, neither triangulated nor saved
+    std::vector<std::vector<uint64_t>> PixelKeys {};    // heights and mask of each stored patch
+    std::vector<std::vector<double>> PredictedCost {};  // triangles of the finest LOD of each stored patch
+    std::vector<std::vector<uint64_t>> Keys {};         // cache keys of the owned rows
+    std::vector<std::vector<char>> Cached {};           // restored, or not this build's to make
+
+    [[nodiscard]] bool IsCached(const int x, const int y) const
     {
-        CompositeNorAo(dir);
-        CompositeAlbRf(dir);
-        ConvertHeight(dir);
+        return x < 0 || y < 0 || x >= Nx || y >= Ny || Cached[y][x];
     }
 
-    return 0;
-    // load heightmap
-    const auto hm = std::make_shared<Heightmap>(inFile);
-
-    const int w = hm->Width();
-    const int h = hm->Height();
-    if (w * h == 0)
+    // A patch restored from the cache brings the border of every LOD it was cut with, lod<N>.edg, and lends
+    // that to its neighbours without being triangulated again. Only the halo rows of a shard, whose files
+    // another shard may still be writing, are triangulated for their borders.
+    [[nodiscard]] bool SavedBorder(const int x, const int y) const
     {
-        std::cerr << "invalid heightmap file (try png, jpg, etc.)" << std::endl;
-        std::exit(1);
+        return Cached[y][x] && !Masked[y][x] && y >= RowBegin && y < RowEnd;
     }
 
-    printf("  %d x %d = %d pixels\n", w, h, w * h);
-
-    const auto patches = hm->SplitIntoPatches(256);
-    std::cout << "patches generated" << std::endl;
-    std::vector<std::pair<float, float>> bounds;
-    for (const auto& row : patches)
-        for (const auto& patch : row)
-            bounds.emplace_back(patch->GetBound());
-    const BoundTree tree(bounds, patches.front().size());
-    tree.SaveJson("asset/bounds.json");
-    std::cout << "bounds generated" << std::endl;
-    const auto nx = patches.front().size();
-    const auto ny = patches.size();
-
-    std::vector meshes(ny, std::vector<std::vector<Triangulator::PackedMesh>>(nx));
+    // Shards and the merge step only agree when they ran on the same pixels with the same settings. A shard
+    // keys the rows it owns, their pixel keys hash its heights and mask, and the merge keys the same rows.
+    [[nodiscard]] uint64_t RowsKey(const int begin, const int end) const
+    {
+        ContentHash hash(Params);
+        for (int y = begin; y < end; ++y)
+            hash.Add(PixelKeys[y]);
+        return hash.Value();
+    }
+};
+
+// Builds the store over the rows this build reads and restores every owned patch the cache holds. The meshes
+// of a patch depend on its pixels, on the LODs of its four neighbours through the rivets, and on the build
+// parameters. Patches whose key hits are restored, the others are rebuilt together with their neighbours,
+// whose LODs they need for the seams. The merge step checks the shards' manifests against the same keys.
+PatchGrid LookUpPatches(const BuildOptions& options, HeightStore& store, const BuildCache& cache,
+    BuildReport& report)
+{
+    PatchGrid grid;
+    grid.Nx = store.Grid().x;
+    grid.Ny = store.Grid().y;
+    const int nx = grid.Nx;
+    const int ny = grid.Ny;
+    const bool merging = options.MergeShards > 0;
+    grid.RowBegin = merging ? 0 : options.Shard.RowBegin(ny);
+    grid.RowEnd = merging ? 0 : options.Shard.RowEnd(ny);
+
+    // a shard stores its rows and their halo, the merge step every row for the pyramid and the bound tree
+    auto stageBegin = Clock::now();
+    const int storeBegin = merging ? 0 : std::max(grid.RowBegin - 1, 0);
+    const int storeEnd = merging ? ny : std::min(grid.RowEnd + 1, ny);
+    const std::filesystem::path storePath = options.Shard.Count
+        ? "asset/shards/shard_" + std::to_string(options.Shard.Index) + "_height.patches"
+        : "asset/height.patches";
+    create_directories(storePath.parent_path());
+    store.Build(storePath, storeBegin, storeEnd);
+    report.Span("height store", -1, -1, stageBegin, Clock::now());
+
+    stageBegin = Clock::now();
     std::vector<std::future<void>> results;
+    // fully masked patches are neither triangulated nor saved, their neighbours see an empty border and
+    // their bound tree leaf has no patch. Merging needs to know them as well.
+    grid.Masked.assign(ny, std::vector<char>(nx, 0));
+    if (store.HasMask())
+    {
+        for (int y = storeBegin; y < storeEnd; ++y)
+            results.emplace_back(g_ThreadPool.enqueue([&grid, &store, nx, y]
+            {
+                for (int x = 0; x < nx; ++x)
+                    grid.Masked[y][x] = store.Patch(x, y)->FullyMasked();
+            }));
+        for (auto& result : results) result.get();
+        results.clear();
+    }
 
-    Triangulator::ErrorHeap errors;
-    errors.emplace(0.0006998777389526367f);
-    errors.emplace(0.00047141313552856445f);
-    errors.emplace(0.0003293752670288086f);
+    // the merge step keys every row, it checks each shard against the rows the shard owned
+    grid.PixelKeys.assign(ny, std::vector<uint64_t>(nx));
+    grid.PredictedCost.assign(ny, std::vector<double>(nx));
+    for (int x = 0; x < nx; ++x)
+        for (int y = storeBegin; y < storeEnd; ++y)
+            results.emplace_back(g_ThreadPool.enqueue([&grid, &store, x, y]
+            {
+                const auto patch = store.Patch(x, y);
+                grid.PixelKeys[y][x] = patch->Hash();
+                grid.PredictedCost[y][x] = PredictTriangles(patch->MeasureRoughness(), LodErrors[0]);
+            }));
+    for (auto& result : results) result.get();
+    results.clear();
 
+    grid.Params.Add("patch 4").Add(256).Add(LodErrors).Add(glm::ivec3(0, 131072, 65536)).Add(HeightScale);
+    if (options.Preview) grid.Params.Add("preview").Add(PreviewStep);
+    // the pixel keys hash each patch's own mask, only masking at all changes how every patch is built
+    if (store.HasMask()) grid.Params.Add("mask");
+    grid.Keys.assign(ny, std::vector<uint64_t>(nx));
+    grid.Cached.assign(ny, std::vector<char>(nx, 1));
     for (int x = 0; x < nx; ++x)
     {
-        for (int y = 0; y < ny; ++y)
+        for (int y = grid.RowBegin; y < grid.RowEnd; ++y)
         {
-            auto& mesh = meshes[y][x];
-            const auto& heightMap = patches[y][x];
-            results.emplace_back(g_ThreadPool.enqueue([&heightMap, x, y, &mesh, &errors]
+            const auto& pixelKeys = grid.PixelKeys;
+            grid.Keys[y][x] = ContentHash(grid.Params).Add(pixelKeys[y][x])
+                .Add(x > 0 ? pixelKeys[y][x - 1] : 0ull).Add(x < nx - 1 ? pixelKeys[y][x + 1] : 0ull)
+                .Add(y > 0 ? pixelKeys[y - 1][x] : 0ull).Add(y < ny - 1 ? pixelKeys[y + 1][x] : 0ull).Value();
+            // nothing to restore, a masked patch counts as cached and only lends its empty border
+            if (grid.Masked[y][x]) continue;
+            results.emplace_back(g_ThreadPool.enqueue([&cache, &grid, x, y]
             {
-                // triangulate
-                Triangulator tri(heightMap, 0, 131072, 65536);
-                tri.Initialize();
-                mesh = tri.RunLod(errors);
-                // SaveErrorStatics(tri.AnalyzeLod());
-
-                // auto mesh = tri.RunLod(triangleCounts);
+                grid.Cached[y][x] = cache.Restore(grid.Keys[y][x],
+                    "asset/" + std::to_string(x) + "_" + std::to_string(y));
             }));
         }
     }
-
     for (auto& result : results) result.get();
     results.clear();
 
-    std::printf("Meshes generated.\n");
-
-    std::vector rivetSets(ny, std::vector<std::unordered_set<Triangulator::PackedPoint>>(nx));
+    int restored = 0;
+    int skipped = 0;
     for (int x = 0; x < nx; ++x)
     {
-        for (int y = 0; y < ny; ++y)
+        for (int y = grid.RowBegin; y < grid.RowEnd; ++y)
+        {
+            restored += grid.Cached[y][x] && !grid.Masked[y][x];
+            skipped += grid.Masked[y][x];
+        }
+    }
+    const int owned = nx * (grid.RowEnd - grid.RowBegin);
+    if (!merging)
+        std::printf("%d of %d patches restored from cache, %d fully masked\n", restored, owned, skipped);
+    report.Span("cache lookup", -1, -1, stageBegin, Clock::now());
+    report.Add("patches", owned);
+    report.Add("patches_restored", restored);
+    report.Add("patches_masked", skipped);
+    if (merging)
+        ShardPlan::CheckManifests("asset", options.MergeShards, nx, ny, LodCount,
+            [&grid](const int begin, const int end) { return grid.RowsKey(begin, end); });
+    return grid;
+}
+
+// Triangulates, cuts and saves every patch the grid does not have yet, and streams every LOD into
+// asset/patches.pak and error.json unless this is a shard.
+// Patch (x, y) is cut and saved as soon as it and its four neighbours are triangulated, no stage waits
+// for the whole world. Triangulation copies out the border of every LOD, the only part the neighbours
+// read for their rivets, so a patch is cut in place while its neighbours may still be gathering.
+// A LOD's border also holds every coarser LOD's, so a coarser neighbour's border is always a subset
+// and the stitching strips only ever close T-junctions.
+void BuildPatches(const BuildOptions& options, const HeightStore& store, const BuildCache& cache,
+    const PatchGrid& grid, BuildReport& report)
+{
+    const int nx = grid.Nx;
+    const int ny = grid.Ny;
+    std::vector meshes(ny, std::vector<std::vector<Triangulator::PackedMesh>>(nx));
+    std::vector borders(ny, std::vector<std::array<EdgeMask, LodCount>>(nx));
+    std::vector triangulated(ny, std::vector<TaskGraph::TaskId>(nx, -1));
+    std::vector released(ny, std::vector<TaskGraph::TaskId>(nx, -1));
+    Triangulator::ErrorHeap errors(std::begin(LodErrors), std::end(LodErrors));
+    TaskGraph graph;
+
+    // Patches are triangulated as a wavefront, one diagonal x + y after the other, so the neighbours of a
+    // patch follow it closely and its cut frees its LODs early. Only a window of triangulated patches holds
+    // LODs at a time: the patch that many places further along waits until this one is released, by its cut
+    // or, when it is only triangulated for its border, right away. A cut waits for neighbours up to two
+    // diagonals ahead, the window never gets narrower than that or it would wait on itself.
+    // Within a diagonal the patches predicted to take longest go first, and of the triangulations ready at
+    // once the most expensive runs first, so rugged patches do not start last and leave a tail.
+    std::vector<glm::ivec2> wavefront;
+    for (int d = 0; d < nx + ny - 1; ++d)
+    {
+        const size_t diagonal = wavefront.size();
+        for (int x = std::max(0, d - ny + 1); x <= std::min(d, nx - 1); ++x)
         {
-            auto& rivetSet = rivetSets[y][x];
-            results.emplace_back(g_ThreadPool.enqueue([x, y, nx, ny, &meshes, &rivetSet]
+            const int y = d - x;
+            if (!grid.IsCached(x, y) || !grid.IsCached(x - 1, y) || !grid.IsCached(x + 1, y) ||
+                !grid.IsCached(x, y - 1) || !grid.IsCached(x, y + 1))
+                wavefront.emplace_back(x, y);
+        }
+        std::stable_sort(wavefront.begin() + diagonal, wavefront.end(),
+            [&grid](const glm::ivec2 a, const glm::ivec2 b)
             {
-                for (const auto& v : meshes[y][x][0].first)
-                    if (v.PosX == 0 || v.PosX == 255 || v.PosY == 0 || v.PosY == 255)
-                        rivetSet.emplace(v);
+                return grid.PredictedCost[a.y][a.x] > grid.PredictedCost[b.y][b.x];
+            });
+    }
+    const int window = std::max(2 * std::min(nx, ny),
+        options.PatchWindow ? options.PatchWindow : 4 * static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector triangulateSeconds(ny, std::vector<double>(nx));
+    std::atomic<int> inFlight = 0;
+    std::atomic<int> peakInFlight = 0;
+    auto release = [&inFlight](std::vector<Triangulator::PackedMesh>& mesh)
+    {
+        std::vector<Triangulator::PackedMesh>().swap(mesh);
+        --inFlight;
+    };
 
-                if (x > 0)
-                    for (const auto& v : meshes[y][x - 1][0].first)
-                        if (v.PosX == 255) rivetSet.emplace(0, v.PosY);
+    // every LOD also streams into one archive the viewer maps, lod 0 is the finest, shards leave that to the
+    // merge step. The surface triangles of each LOD are counted on the way in for error.json.
+    std::unique_ptr<PatchArchiveWriter> archive = nullptr;
+    if (!options.Shard.Count)
+        archive = std::make_unique<PatchArchiveWriter>("asset/patches.pak", nx, ny, LodCount,
+            sizeof(Triangulator::PackedPoint), HeightScale, options.CompressMeshes, &g_Writer);
+    // Whatever goes into the archive is also run through the GPU efficiency analysis, but for previews.
+    std::array<std::atomic<uint64_t>, LodCount> lodTriangles {};
+    MeshAnalyzer analyzer(report, nx, ny, LodCount, HeightScale);
+    auto archiveLod = [&archive, &lodTriangles, &analyzer, &store, analyze = !options.Preview](
+        const int x, const int y, const int lod, const std::vector<Triangulator::PackedPoint>& vb, const void* ib,
+        const size_t indexCount, std::vector<PatchArchive::Cluster> clusters,
+        std::vector<PatchArchive::Stitch> stitches)
+    {
+        if (lod >= LodCount || !archive) return;
+        const uint32_t indexWidth = vb.size() > std::numeric_limits<std::uint16_t>::max() ? 4 : 2;
+        const uint32_t surface = PatchArchive::SurfaceIndexCount(static_cast<uint32_t>(indexCount), stitches.data(),
+            static_cast<uint32_t>(stitches.size()));
+        lodTriangles[lod] += surface / 3;
 
-                if (x < nx - 1)
-                    for (const auto& v : meshes[y][x + 1][0].first)
-                        if (v.PosX == 0) rivetSet.emplace(255, v.PosY);
+        if (analyze)
+        {
+            std::vector<uint32_t> surfaceIndices(surface);
+            if (indexWidth == 4)
+                std::copy_n(static_cast<const uint32_t*>(ib), surface, surfaceIndices.begin());
+            else
+                std::copy_n(static_cast<const uint16_t*>(ib), surface, surfaceIndices.begin());
+            analyzer.Add(x, y, lod, *store.Patch(x, y), vb, surfaceIndices, clusters.size());
+        }
 
-                if (y > 0)
-                    for (const auto& v : meshes[y - 1][x][0].first)
-                        if (v.PosY == 255) rivetSet.emplace(v.PosX, 0);
+        archive->Add(x, y, lod, LodErrors[lod], vb.data(), static_cast<uint32_t>(vb.size()),
+            ib, static_cast<uint32_t>(indexCount), indexWidth, std::move(clusters), std::move(stitches));
+    };
+    for (const auto& patch : wavefront)
+    {
+        const int x = patch.x;
+        const int y = patch.y;
+        auto& mesh = meshes[y][x];
+        auto& border = borders[y][x];
+        const bool borderOnly = grid.Cached[y][x];
+        const bool saved = grid.SavedBorder(x, y);
+        const bool empty = grid.Masked[y][x];
+        triangulated[y][x] = graph.Add([x, y, borderOnly, saved, empty, preview = options.Preview, &store, &mesh,
+            &border, &errors, &report, &inFlight, &peakInFlight, &release, &triangulateSeconds]
+        {
+            const int count = ++inFlight;
+            int peak = peakInFlight;
+            while (count > peak && !peakInFlight.compare_exchange_weak(peak, count)) {}
 
-                if (y < ny - 1)
-                    for (const auto& v : meshes[y + 1][x][0].first)
-                        if (v.PosY == 0) rivetSet.emplace(v.PosX, 255);
-            }));
-        }
-    }
+            if (saved)
+            {
+                BuildReport::Scope scope(report, "border", x, y);
+                const std::string dir = "asset/" + std::to_string(x) + "_" + std::to_string(y) + "/lod";
+                for (int lod = 0; lod < LodCount; ++lod)
+                {
+                    const auto path = dir + std::to_string(lod) + ".edg";
+                    const auto edges = LoadBin<EdgeMask>(path);
+                    if (edges.size() != 1)
+                        throw std::runtime_error(path + " is not an edge mask");
+                    border[lod] = edges.front();
+                }
+                release(mesh);
+                return;
+            }
 
-    for (auto& result : results) result.get();
-    results.clear();
+            BuildReport::Scope scope(report, "triangulate", x, y);
+            // triangulate
+            const auto triangulateBegin = Clock::now();
+            if (empty)
+            {
+                mesh.assign(LodCount, {});
+            }
+            else if (preview)
+            {
+                // one mesh for every LOD, so the borders match and no strips are needed
+                mesh.assign(LodCount, TriangulatePreview(*store.Patch(x, y), LodErrors[LodCount - 1]));
+            }
+            else
+            {
+                // the patch stays in memory as long as the triangulator
+                Triangulator tri(store.Patch(x, y), 0, 131072, 65536);
+                tri.Initialize();
+                mesh = tri.RunLod(errors);
+                // SaveErrorStatics(tri.AnalyzeLod());
+
+                // auto mesh = tri.RunLod(triangleCounts);
+
+                report.AddPatch(x, y, "steps", static_cast<double>(tri.Steps()));
+                report.AddPatch(x, y, "flips", static_cast<double>(tri.Flips()));
+                report.Add("steps", static_cast<double>(tri.Steps()));
+                report.Add("flips", static_cast<double>(tri.Flips()));
+            }
+            triangulateSeconds[y][x] = std::chrono::duration<double>(Clock::now() - triangulateBegin).count();
 
-    std::printf("Neighbors generated.\n");
+            for (int lod = LodCount - 1; lod >= 0; --lod)
+            {
+                border[lod] = EdgeMask::FromVertices(mesh[lod].first);
+                if (lod < LodCount - 1) border[lod] |= border[lod + 1];
+            }
+
+            // a restored patch only lends its border to the neighbours' rivets
+            if (borderOnly) release(mesh);
+        });
+        graph.SetPriority(triangulated[y][x], saved ? 0.0 : grid.PredictedCost[y][x]);
+        if (borderOnly) released[y][x] = triangulated[y][x];
+    }
 
     for (int x = 0; x < nx; ++x)
     {
         for (int y = 0; y < ny; ++y)
         {
+            if (grid.Masked[y][x])
+            {
+                // recorded as empty, the viewer tells it from a patch that went missing
+                if (archive)
+                    for (int lod = 0; lod < LodCount; ++lod)
+                        archive->AddEmpty(x, y, lod, LodErrors[lod]);
+                continue;
+            }
+            if (grid.Cached[y][x])
+            {
+                // a shard's restored patches are already in place, rows it does not own are not its business
+                if (!archive) continue;
+                graph.Add([x, y, &archiveLod, &report]
+                {
+                    BuildReport::Scope scope(report, "restore", x, y);
+                    const std::string dir = "asset/" + std::to_string(x) + "_" + std::to_string(y) + "/lod";
+                    for (int lod = 0; lod < LodCount; ++lod)
+                    {
+                        const auto vb = LoadBin<Triangulator::PackedPoint>(dir + std::to_string(lod) + ".vtx");
+                        const auto ib = LoadBin<std::byte>(dir + std::to_string(lod) + ".idx");
+                        auto clusters = LoadBin<PatchArchive::Cluster>(dir + std::to_string(lod) + ".cls");
+                        auto stitches = LoadBin<PatchArchive::Stitch>(dir + std::to_string(lod) + ".stc");
+                        const size_t indexWidth = vb.size() > std::numeric_limits<std::uint16_t>::max() ? 4 : 2;
+                        archiveLod(x, y, lod, vb, ib.data(), ib.size() / indexWidth, std::move(clusters),
+                            std::move(stitches));
+                    }
+                });
+                continue;
+            }
             auto& meshLods = meshes[y][x];
-            auto& rivetSet = rivetSets[y][x];
-            results.emplace_back(g_ThreadPool.enqueue([x, y, &meshLods, &rivetSet]
+            const uint64_t key = grid.Keys[y][x];
+            const auto cut = graph.Add([x, y, nx, ny, key, preview = options.Preview, &cache, &meshLods, &borders,
+                &grid, &store, &archiveLod, &report, &release]
             {
-                for (auto& lod : meshLods)
-                    SideCutter::Cut(lod, 256,
-                        [&rivetSet](Triangulator::PackedPoint p)
+                auto stageBegin = Clock::now();
+                const auto heightMap = store.Patch(x, y);
+                // every LOD's seams are riveted to the same LOD of the neighbours only
+                std::array<EdgeMask, LodCount> rivets = borders[y][x];
+                for (int lod = 0; lod < LodCount; ++lod)
+                {
+                    if (x > 0) rivets[lod].Merge(EdgeMask::Left, borders[y][x - 1][lod]);
+                    if (x < nx - 1) rivets[lod].Merge(EdgeMask::Right, borders[y][x + 1][lod]);
+                    if (y > 0) rivets[lod].Merge(EdgeMask::Top, borders[y - 1][x][lod]);
+                    if (y < ny - 1) rivets[lod].Merge(EdgeMask::Bottom, borders[y + 1][x][lod]);
+                }
+                report.Span("rivet", x, y, stageBegin, Clock::now());
+
+                stageBegin = Clock::now();
+                for (int lod = 0; lod < LodCount; ++lod)
+                    SideCutter::Cut(meshLods[lod], 256,
+                        [&rivets, lod](const Triangulator::PackedPoint p)
                         {
-                            return rivetSet.count(p) > 0;
+                            return rivets[lod].Contains(p);
                         });
+                report.Span("cut", x, y, stageBegin, Clock::now());
 
+                stageBegin = Clock::now();
+                std::vector<std::vector<PatchArchive::Cluster>> clusterLods(meshLods.size());
+                std::vector<std::vector<PatchArchive::Stitch>> stitchLods(meshLods.size());
+                for (int lod = 0; lod < meshLods.size(); ++lod)
+                {
+                    auto& [vb, ib] = meshLods[lod];
+                    if (!preview)
+                    {
+                        OptimizeMeshRedundant(vb, ib);
+                        OptimizeMeshCache(vb, ib);
+                        clusterLods[lod] = ClusterBuilder::Build(vb, ib, *heightMap, HeightScale);
+                    }
+
+                    // strips towards every coarser LOD of every neighbour with meshes, behind the clustered surface
+                    const auto& masked = grid.Masked;
+                    const bool hasNeighbour[EdgeMask::SideCount] =
+                    {
+                        x > 0 && !masked[y][x - 1], x < nx - 1 && !masked[y][x + 1],
+                        y > 0 && !masked[y - 1][x], y < ny - 1 && !masked[y + 1][x],
+                    };
+                    size_t stitchIndices = 0;
+                    for (int side = 0; side < EdgeMask::SideCount; ++side)
+                    {
+                        if (!hasNeighbour[side]) continue;
+                        for (int coarse = lod + 1; coarse < LodCount; ++coarse)
+                        {
+                            const auto strip = SideCutter::Stitch(vb, static_cast<EdgeMask::Side>(side),
+                                rivets[coarse], [&heightMap](const Triangulator::PackedPoint p)
+                                {
+                                    return heightMap->At(p.PosX, p.PosY);
+                                });
+                            if (strip.empty()) continue;
+                            stitchLods[lod].push_back({ static_cast<uint32_t>(side), static_cast<uint32_t>(coarse),
+                                static_cast<uint32_t>(ib.size()), static_cast<uint32_t>(strip.size()) });
+                            ib.insert(ib.end(), strip.begin(), strip.end());
+                            stitchIndices += strip.size();
+                        }
+                    }
+
+                    const std::string prefix = "lod" + std::to_string(lod);
+                    const size_t surfaceIndices = ib.size() - stitchIndices;
+                    report.AddPatch(x, y, prefix + "_triangles", static_cast<double>(surfaceIndices / 3));
+                    report.AddPatch(x, y, prefix + "_vertices", static_cast<double>(vb.size()));
+                    report.AddPatch(x, y, prefix + "_clusters", static_cast<double>(clusterLods[lod].size()));
+                    report.Add(prefix + "_triangles", static_cast<double>(surfaceIndices / 3));
+                    report.Add(prefix + "_stitch_triangles", static_cast<double>(stitchIndices / 3));
+                }
+                report.Span("optimize", x, y, stageBegin, Clock::now());
 
+                BuildReport::Scope scope(report, "write", x, y);
                 const std::filesystem::path path = "asset/" + std::to_string(x) + "_" + std::to_string(y);
                 create_directories(path);
 
+                std::vector<std::filesystem::path> outputs;
                 for (int lod = 0; lod < meshLods.size(); ++lod)
                 {
                     auto& [vb, ib] = meshLods[lod];
+                    auto& clusters = clusterLods[lod];
+                    auto& stitches = stitchLods[lod];
                     const auto vbPath = path.u8string() + "/lod" + std::to_string(lod) + ".vtx";
                     const auto ibPath = path.u8string() + "/lod" + std::to_string(lod) + ".idx";
+                    const auto clsPath = path.u8string() + "/lod" + std::to_string(lod) + ".cls";
+                    const auto stcPath = path.u8string() + "/lod" + std::to_string(lod) + ".stc";
 
-                    OptimizeMeshRedundant(vb, ib);
-                    OptimizeMeshCache(vb, ib);
                     SaveBin(vbPath, vb);
+                    SaveBin(clsPath, clusters);
+                    SaveBin(stcPath, stitches);
                     if (vb.size() > std::numeric_limits<std::uint16_t>::max())
+                    {
                         SaveBin(ibPath, ib);
+                        archiveLod(x, y, lod, vb, ib.data(), ib.size(), std::move(clusters), std::move(stitches));
+                    }
                     else
-                        SaveBin(ibPath, std::vector<std::uint16_t>(ib.begin(), ib.end()));
+                    {
+                        const std::vector<std::uint16_t> ib16(ib.begin(), ib.end());
+                        SaveBin(ibPath, ib16);
+                        archiveLod(x, y, lod, vb, ib16.data(), ib16.size(), std::move(clusters), std::move(stitches));
+                    }
+                    const auto edgPath = path.u8string() + "/lod" + std::to_string(lod) + ".edg";
+                    SaveBin(edgPath, std::vector<EdgeMask>{ borders[y][x][lod] });
+                    outputs.emplace_back(vbPath);
+                    outputs.emplace_back(ibPath);
+                    outputs.emplace_back(clsPath);
+                    outputs.emplace_back(stcPath);
+                    outputs.emplace_back(edgPath);
                 }
-            }));
+                g_Writer.Post([cache, key, outputs] { cache.Store(key, outputs); });
+                release(meshLods);
+            });
+            // a cut frees its place in the window, it goes before any triangulation
+            graph.SetPriority(cut, std::numeric_limits<double>::max());
+            released[y][x] = cut;
+
+            graph.Precede(triangulated[y][x], cut);
+            if (x > 0) graph.Precede(triangulated[y][x - 1], cut);
+            if (x < nx - 1) graph.Precede(triangulated[y][x + 1], cut);
+            if (y > 0) graph.Precede(triangulated[y - 1][x], cut);
+            if (y < ny - 1) graph.Precede(triangulated[y + 1][x], cut);
         }
     }
 
-    for (auto& result : results) result.get();
+    for (size_t i = window; i < wavefront.size(); ++i)
+    {
+        const auto& before = wavefront[i - window];
+        graph.Precede(released[before.y][before.x], triangulated[wavefront[i].y][wavefront[i].x]);
+    }
+
+    auto stageBegin = Clock::now();
+    graph.Run();
+    std::printf("%zu patches triangulated, at most %d of them in memory at once\n", wavefront.size(),
+        peakInFlight.load());
+    report.Add("patch_window", window);
+    report.Add("patches_in_memory_peak", peakInFlight.load());
+    // what was only loaded says nothing about the cost of a triangulation
+    std::vector<glm::ivec2> measured;
+    std::copy_if(wavefront.begin(), wavefront.end(), std::back_inserter(measured),
+        [&grid](const glm::ivec2 p) { return !grid.SavedBorder(p.x, p.y); });
+    ReportCostModel(report, measured, grid.PredictedCost, triangulateSeconds);
+    report.Span("patches", -1, -1, stageBegin, Clock::now());
+    if (!archive) return;
+
+    stageBegin = Clock::now();
+    archive->Finish();
+    g_Writer.Flush();
+    std::map<float, int> errorStatistics;
+    for (int lod = 0; lod < LodCount; ++lod)
+        errorStatistics[LodErrors[lod]] = static_cast<int>(lodTriangles[lod].load());
+    SaveErrorStatics(errorStatistics);
+    report.Span("archive", -1, -1, stageBegin, Clock::now());
+
+    // a preview is coarser than any LOD it stands in for, only a full build is measured and checked
+    if (!options.Preview)
+    {
+        stageBegin = Clock::now();
+        analyzer.Finish("asset");
+        report.Span("analyze", -1, -1, stageBegin, Clock::now());
+    }
+}
+
+// Checks every mesh the build leaves in asset, restored patches included, against the heights. False on the
+// first bad mesh, with the messages on stderr.
+bool ValidatePatches(const HeightStore& store, const PatchGrid& grid, BuildReport& report)
+{
+    const auto stageBegin = Clock::now();
+    const auto validation = MeshValidator(grid.Nx, grid.Ny,
+        std::vector<float>(std::begin(LodErrors), std::end(LodErrors))).Run(
+        [&grid](const int x, const int y)
+        {
+            if (grid.Masked[y][x]) return std::vector<MeshValidator::Lod>();
+            const std::string dir = "asset/" + std::to_string(x) + "_" + std::to_string(y) + "/lod";
+            std::vector<MeshValidator::Lod> lods(LodCount);
+            for (int lod = 0; lod < LodCount; ++lod)
+            {
+                auto& [vb, ib, stitches] = lods[lod];
+                vb = LoadBin<Triangulator::PackedPoint>(dir + std::to_string(lod) + ".vtx");
+                if (vb.size() > std::numeric_limits<std::uint16_t>::max())
+                    ib = LoadBin<uint32_t>(dir + std::to_string(lod) + ".idx");
+                else
+                {
+                    const auto ib16 = LoadBin<uint16_t>(dir + std::to_string(lod) + ".idx");
+                    ib.assign(ib16.begin(), ib16.end());
+                }
+                stitches = LoadBin<PatchArchive::Stitch>(dir + std::to_string(lod) + ".stc");
+            }
+            return lods;
+        },
+        [&store](const int x, const int y)
+        {
+            return store.Patch(x, y);
+        });
+    std::printf("validated %d patches, %d edges, %llu triangles, %llu errors\n", validation.Patches,
+        validation.Edges, static_cast<unsigned long long>(validation.Triangles),
+        static_cast<unsigned long long>(validation.Errors));
+    for (int lod = 0; lod < LodCount; ++lod)
+    {
+        std::printf("  lod %d deviates up to %g, built for %g\n", lod, validation.MaxDeviation[lod], LodErrors[lod]);
+        report.Add("lod" + std::to_string(lod) + "_max_deviation", validation.MaxDeviation[lod]);
+    }
+    report.Add("validation_errors", static_cast<double>(validation.Errors));
+    report.Span("validate", -1, -1, stageBegin, Clock::now());
+    if (validation.Ok()) return true;
+    for (const auto& message : validation.Messages)
+        std::cerr << message << std::endl;
+    return false;
+}
+
+// Saves the height pyramid and the bound tree over all patches, and merges the far field: every internal
+// bound tree node gets one mesh from the coarsest LOD below it, in asset/hlod.pak. A preview has none, its
+// patches are as coarse as a far field already and the viewer draws them all the way out.
+void BuildFarField(const BuildOptions& options, const HeightStore& store, const PatchGrid& grid,
+    BuildReport& report)
+{
+    auto stageBegin = Clock::now();
+    const auto& pyramid = *store.Pyramid();
+    pyramid.Save("asset/height.pyramid");
+    std::cout << "height pyramid generated" << std::endl;
+    report.Span("pyramid", -1, -1, stageBegin, Clock::now());
+
+    stageBegin = Clock::now();
+    // saved once the HLOD stage has numbered its internal nodes
+    BoundTree tree(pyramid, grid.Nx, grid.Ny, [&grid](const int x, const int y) { return grid.Masked[y][x] != 0; });
+    report.Span("bounds", -1, -1, stageBegin, Clock::now());
+
+    stageBegin = Clock::now();
+    std::vector<Triangulator::PackedMesh> hlods;
+    if (options.Preview)
+    {
+        // a full build's, numbered for the internal nodes of another tree
+        std::filesystem::remove("asset/hlod.pak");
+    }
+    else
+    {
+        hlods = HlodBuilder([&store](const int x, const int y) { return store.Patch(x, y); }, HeightScale).Run(tree,
+            [](const int x, const int y)
+        {
+            const std::string path = "asset/" + std::to_string(x) + "_" + std::to_string(y) + "/lod" +
+                std::to_string(LodCount - 1);
+            Triangulator::PackedMesh mesh;
+            mesh.first = LoadBin<Triangulator::PackedPoint>(path + ".vtx");
+            if (mesh.first.size() > std::numeric_limits<std::uint16_t>::max())
+                mesh.second = LoadBin<uint32_t>(path + ".idx");
+            else
+            {
+                const auto ib16 = LoadBin<uint16_t>(path + ".idx");
+                mesh.second.assign(ib16.begin(), ib16.end());
+            }
+            // the surface only, the stitching strips stand upright on the seams
+            const auto stitches = LoadBin<PatchArchive::Stitch>(path + ".stc");
+            mesh.second.resize(PatchArchive::SurfaceIndexCount(static_cast<uint32_t>(mesh.second.size()),
+                stitches.data(), static_cast<uint32_t>(stitches.size())));
+            return mesh;
+        });
+    }
+    if (!hlods.empty())
+    {
+        PatchArchiveWriter hlodArchive("asset/hlod.pak", static_cast<int>(hlods.size()), 1, 1,
+            sizeof(Triangulator::PackedPoint), HeightScale, options.CompressMeshes, &g_Writer);
+        for (int i = 0; i < static_cast<int>(hlods.size()); ++i)
+        {
+            auto& [vb, ib] = hlods[i];
+            OptimizeMeshRedundant(vb, ib);
+            OptimizeMeshCache(vb, ib);
+            if (vb.size() > std::numeric_limits<std::uint16_t>::max())
+                hlodArchive.Add(i, 0, 0, 0.0f, vb.data(), static_cast<uint32_t>(vb.size()),
+                    ib.data(), static_cast<uint32_t>(ib.size()), 4);
+            else
+            {
+                const std::vector<std::uint16_t> ib16(ib.begin(), ib.end());
+                hlodArchive.Add(i, 0, 0, 0.0f, vb.data(), static_cast<uint32_t>(vb.size()),
+                    ib16.data(), static_cast<uint32_t>(ib16.size()), 2);
+            }
+            report.Add("hlod_triangles", static_cast<double>(ib.size() / 3));
+        }
+        hlodArchive.Finish();
+    }
+    tree.SaveJson("asset/bounds.json");
+    std::cout << "bounds generated" << std::endl;
+    report.Add("hlods", static_cast<double>(hlods.size()));
+    report.Span("hlod", -1, -1, stageBegin, Clock::now());
+}
+
+// Main code
+int main(int argc, char** argv)
+{
+    if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED)))
+    {
+        std::cerr << "failed to initialize COM" << std::endl;
+        return 1;
+    }
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    if (argc < 2) return 1;
+    const BuildOptions options = ParseOptions(argc, argv);
+    const std::string& inFile = options.Input;
+    const std::wstring parent = std::filesystem::path(inFile).parent_path().wstring();
+
+    // outputs of earlier runs, keyed by the hash of everything that went into them
+    const BuildCache cache("asset/cache", options.Cache);
+
+    BuildReport report;
+    // every way out waits for the writer and leaves the report behind, shards each their own
+    const auto finish = [&report, &options]
+    {
+        g_Writer.Flush();
+        report.Add("bytes_written", static_cast<double>(g_Writer.WrittenBytes()));
+        report.Add("write_seconds", g_Writer.WriteSeconds());
+        const std::string name = options.Shard.Count
+            ? "asset/shards/shard_" + std::to_string(options.Shard.Index) + "_build_"
+            : "asset/build_";
+        create_directories(std::filesystem::path(name).parent_path());
+        report.Save(name + "report.json", options.Trace ? name + "trace.json" : "");
+        return 0;
+    };
+
+    if (options.Textures)
+    {
+        BuildReport::Scope scope(report, "textures");
+        const auto clipmapPath = parent + L"/clipmap";
+        std::filesystem::create_directories(clipmapPath);
+        const auto footprintKey = ContentHash().Add("footprints 1").Value();
+        if (!cache.Restore(footprintKey, clipmapPath))
+        {
+            GenerateClipmapFootPrints(clipmapPath);
+            // queued behind the footprint files so it only sees them complete
+            g_Writer.Post([cache, footprintKey, clipmapPath] { cache.StoreDirectory(footprintKey, clipmapPath); });
+        }
+
+        // Every composite of every material is its own pool task, so one material's mips are generated
+        // while the next one is still loading. The pool threads join the multithreaded apartment main
+        // initialized, which is all WIC needs.
+        std::vector<std::future<void>> composites;
+        for (auto&& dir : std::filesystem::directory_iterator(parent + L"\\texture_can"))
+        {
+            const std::filesystem::path p = dir.path();
+            composites.emplace_back(g_ThreadPool.enqueue([p, &cache] { CompositeNorAo(p, cache); }));
+            composites.emplace_back(g_ThreadPool.enqueue([p, &cache] { CompositeAlbRf(p, cache); }));
+            composites.emplace_back(g_ThreadPool.enqueue([p, &cache] { ConvertHeight(p, cache); }));
+        }
+        for (auto& composite : composites) composite.get();
+    }
+
+    if (!options.Meshes && !options.Horizon && !options.Tiles && !options.Splat)
+        return finish();
+
+    // The mesh stage streams the heightmap through a store of patches, only the stages sweeping the whole map
+    // load it whole, and drop it again before the meshes.
+    HeightStore store(inFile, 256);
+    const int w = store.Width();
+    const int h = store.Height();
+    if (w * h == 0)
+    {
+        std::cerr << "invalid heightmap file (try png, jpg, etc.)" << std::endl;
+        std::exit(1);
+    }
+
+    printf("  %d x %d = %d pixels\n", w, h, w * h);
+    if (!options.Mask.empty()) store.MaskImage(options.Mask);
+    if (options.SeaLevel >= 0.0f) store.MaskBelow(options.SeaLevel);
+
+    std::filesystem::create_directories("asset");
+    const bool wholeMap = options.Horizon || options.Tiles || options.Splat;
+    if (wholeMap)
+    {
+        // load heightmap
+        const auto stageBegin = Clock::now();
+        const auto hm = std::make_shared<Heightmap>(inFile);
+        report.Span("load", -1, -1, stageBegin, Clock::now());
+        if (!options.Mask.empty()) hm->MaskImage(options.Mask);
+        if (options.SeaLevel >= 0.0f) hm->MaskBelow(options.SeaLevel);
+        if (hm->HasMask())
+        {
+            const size_t masked = hm->MaskedCount();
+            printf("  %zu pixels masked (%.1f%%)\n", masked, 100.0 * masked / (static_cast<double>(w) * h));
+            report.Add("masked_pixels", static_cast<double>(masked));
+        }
+
+        std::unique_ptr<HorizonBaker> horizon = nullptr;
+        if (options.Horizon)
+        {
+            BuildReport::Scope scope(report, "horizon");
+            horizon = std::make_unique<HorizonBaker>(*hm, HeightScale);
+            horizon->Run("asset");
+            horizon->SaveAo("asset/ao.dds");
+            horizon->SaveAoTiles("asset", options.TilesX, options.TilesY);
+        }
+        if (options.Tiles || options.Splat)
+        {
+            BuildReport::Scope scope(report, "tiles");
+            SourceTiler tiler(*hm, HeightScale, options.TilesX, options.TilesY);
+            if (horizon) tiler.SetAo(&horizon->Ao());
+
+            std::unique_ptr<SplatBaker> splat = nullptr;
+            if (options.Splat)
+            {
+                const auto rulesPath = std::filesystem::path(inFile).parent_path() / "splat_rules.json";
+                splat = std::make_unique<SplatBaker>(*hm, HeightScale,
+                    exists(rulesPath) ? SplatBaker::LoadRules(rulesPath) : SplatBaker::DefaultRules());
+                tiler.SetSplat([&splat](const int x, const int y, const int count, uint32_t* out)
+                {
+                    splat->EvaluateRow(x, y, count, out);
+                });
+            }
+            // the splat tiles are only rewritten with --splat, whatever is there otherwise stays
+            unsigned layers = options.Splat ? SourceTiler::SplatLayer : 0u;
+            if (options.Tiles) layers |= SourceTiler::HeightLayer | SourceTiler::NormalLayer;
+            tiler.Run("asset", layers);
+        }
+    }
+    if (!options.Meshes)
+        return finish();
+
+    // Patches are not split off up front, the store writes them to a scratch file in one pass over the source
+    // and every task reads back the patch it works on. A patch is in memory while some task holds it.
+    const auto grid = LookUpPatches(options, store, cache, report);
+    if (store.HasMask() && !wholeMap)
+    {
+        printf("  %zu pixels masked\n", store.MaskedCount());
+        report.Add("masked_pixels", static_cast<double>(store.MaskedCount()));
+    }
+    BuildPatches(options, store, cache, grid, report);
+    if (options.Shard.Count)
+    {
+        // the manifest goes last, once everything the merge step reads is on disk
+        g_Writer.Flush();
+        options.Shard.SaveManifest("asset", grid.Nx, grid.Ny, LodCount, grid.RowsKey(grid.RowBegin, grid.RowEnd));
+        return finish();
+    }
+    if (!options.Preview && !ValidatePatches(store, grid, report))
+    {
+        finish();
+        return 1;
+    }
+    BuildFarField(options, store, grid, report);
+
+    g_Writer.Report();
+    std::printf("Meshes generated.\n");
 
     const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     std::cout << "Elapsed time in seconds : "
         << std::chrono::duration_cast<std::chrono::seconds>(end - begin).count()
         << " s" << std::endl;
-    return 0;
+    return finish();
 }
@@ -0,0 +1,126 @@
+#include "MeshAnalyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <meshoptimizer.h>
+#include <string>
+
+#include "PngWriter.h"
+
+namespace
+{
+    constexpr int PatchSize = 255;
+}
+
+MeshAnalyzer::MeshAnalyzer(BuildReport& report, const int nx, const int ny, const int lodCount,
+    const float heightScale) :
+    m_Report(report), m_Nx(nx), m_Ny(ny), m_HeightScale(heightScale), m_Totals(lodCount),
+    m_Density(lodCount, std::vector<uint32_t>(static_cast<size_t>(nx) * DensityCells * ny * DensityCells))
+{
+}
+
+void MeshAnalyzer::Add(const int x, const int y, const int lod, const Heightmap& heightmap,
+    const std::vector<Triangulator::PackedPoint>& vertices, const std::vector<uint32_t>& indices,
+    const size_t clusterCount)
+{
+    const size_t triangles = indices.size() / 3;
+    if (triangles == 0) return;
+
+    const auto cache = meshopt_analyzeVertexCache(indices.data(), indices.size(), vertices.size(), CacheSize, 0, 0);
+    const auto fetch = meshopt_analyzeVertexFetch(indices.data(), indices.size(), vertices.size(),
+        sizeof(Triangulator::PackedPoint));
+
+    // overdraw is rasterized from the three axes, so the heights go in at their world scale
+    std::vector<float> positions(vertices.size() * 3);
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        positions[i * 3] = vertices[i].PosX;
+        positions[i * 3 + 1] = heightmap.At(vertices[i].PosX, vertices[i].PosY) * m_HeightScale;
+        positions[i * 3 + 2] = vertices[i].PosY;
+    }
+    const auto overdraw = meshopt_analyzeOverdraw(indices.data(), indices.size(), positions.data(), vertices.size(),
+        sizeof(float) * 3);
+
+    std::vector<uint32_t> strip(meshopt_stripifyBound(indices.size()));
+    const size_t stripIndices = meshopt_stripify(strip.data(), indices.data(), indices.size(), vertices.size(),
+        ~0u);
+    const size_t indexWidth = vertices.size() > std::numeric_limits<uint16_t>::max() ? 4 : 2;
+
+    const std::string prefix = "lod" + std::to_string(lod);
+    m_Report.AddPatch(x, y, prefix + "_acmr", cache.acmr);
+    m_Report.AddPatch(x, y, prefix + "_atvr", cache.atvr);
+    m_Report.AddPatch(x, y, prefix + "_overfetch", fetch.overfetch);
+    m_Report.AddPatch(x, y, prefix + "_overdraw", overdraw.overdraw);
+
+    // the density cells of this patch, a centroid on the far border counts into the last cell
+    const int stride = m_Nx * DensityCells;
+    std::vector<uint32_t> cells(DensityCells * DensityCells);
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const auto& p0 = vertices[indices[t]];
+        const auto& p1 = vertices[indices[t + 1]];
+        const auto& p2 = vertices[indices[t + 2]];
+        const int cx = std::min((p0.PosX + p1.PosX + p2.PosX) * DensityCells / (3 * PatchSize), DensityCells - 1);
+        const int cy = std::min((p0.PosY + p1.PosY + p2.PosY) * DensityCells / (3 * PatchSize), DensityCells - 1);
+        ++cells[cy * DensityCells + cx];
+    }
+
+    std::lock_guard lock(m_Mutex);
+    auto& totals = m_Totals[lod];
+    totals.Triangles += static_cast<double>(triangles);
+    totals.Vertices += static_cast<double>(vertices.size());
+    totals.Transformed += cache.vertices_transformed;
+    totals.BytesFetched += fetch.bytes_fetched;
+    totals.PixelsCovered += overdraw.pixels_covered;
+    totals.PixelsShaded += overdraw.pixels_shaded;
+    totals.StripIndices += static_cast<double>(stripIndices);
+    totals.Clusters += static_cast<double>(clusterCount);
+    totals.IndexBytes += static_cast<double>(indices.size() * indexWidth);
+    totals.Patches += 1.0;
+    auto& density = m_Density[lod];
+    for (int j = 0; j < DensityCells; ++j)
+        for (int i = 0; i < DensityCells; ++i)
+            density[static_cast<size_t>(y * DensityCells + j) * stride + x * DensityCells + i] +=
+                cells[j * DensityCells + i];
+}
+
+void MeshAnalyzer::Finish(const std::filesystem::path& dir) const
+{
+    std::lock_guard lock(m_Mutex);
+    for (size_t lod = 0; lod < m_Totals.size(); ++lod)
+    {
+        const auto& t = m_Totals[lod];
+        if (t.Triangles == 0.0) continue;
+
+        const std::string prefix = "lod" + std::to_string(lod);
+        const double indices = t.Triangles * 3.0;
+        m_Report.Add(prefix + "_acmr", t.Transformed / t.Triangles);
+        m_Report.Add(prefix + "_atvr", t.Transformed / t.Vertices);
+        m_Report.Add(prefix + "_overfetch", t.BytesFetched / (t.Vertices * sizeof(Triangulator::PackedPoint)));
+        m_Report.Add(prefix + "_overdraw", t.PixelsCovered > 0.0 ? t.PixelsShaded / t.PixelsCovered : 0.0);
+        m_Report.Add(prefix + "_strip_ratio", t.StripIndices / indices);
+        m_Report.Add(prefix + "_cluster_fill", t.Clusters > 0.0 ? t.Triangles / t.Clusters : 0.0);
+        m_Report.Add(prefix + "_index_bytes", t.IndexBytes);
+        m_Report.Add(prefix + "_index_bytes_32", indices * sizeof(uint32_t));
+        std::printf("lod %zu: acmr %.3f, atvr %.3f, overfetch %.3f, overdraw %.3f, strip %.2f of list\n", lod,
+            t.Transformed / t.Triangles, t.Transformed / t.Vertices,
+            t.BytesFetched / (t.Vertices * sizeof(Triangulator::PackedPoint)),
+            t.PixelsCovered > 0.0 ? t.PixelsShaded / t.PixelsCovered : 0.0, t.StripIndices / indices);
+
+        // 8 bit, scaled so the densest cell is white
+        const auto& density = m_Density[lod];
+        const uint32_t peak = std::max(*std::max_element(density.begin(), density.end()), 1u);
+        const int width = m_Nx * DensityCells;
+        const int height = m_Ny * DensityCells;
+        std::vector<uint8_t> pixels(density.size());
+        std::transform(density.begin(), density.end(), pixels.begin(), [peak](const uint32_t n)
+        {
+            return static_cast<uint8_t>((static_cast<uint64_t>(n) * 255 + peak / 2) / peak);
+        });
+        const auto path = dir / ("density_" + prefix + ".png");
+        PngWriter::Save(path, pixels.data(), width, height, 1);
+        std::printf("%s generated, densest cell %u triangles\n", path.u8string().c_str(), peak);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "BuildReport.h"
+#include "heightmap.h"
+#include "triangulator.h"
+
+// What the GPU would make of the emitted meshes, simulated on the CPU with meshoptimizer's analyzers.
+// Every archived LOD reports its post transform cache ratios (ACMR per triangle, ATVR per vertex) for
+// a generic 16 entry FIFO, its vertex fetch overfetch and its overdraw. It also reports the index
+// count a strip would take and how full its clusters are, which shows whether strips, meshlets or
+// 16 bit indices pay off for terrain. Rows go into the report per patch, totals per LOD, and the
+// triangle density per LOD is saved as a map over the whole world.
+class MeshAnalyzer
+{
+public:
+    MeshAnalyzer(BuildReport& report, int nx, int ny, int lodCount, float heightScale);
+
+    // thread safe, indices are the surface only
+    void Add(int x, int y, int lod, const Heightmap& heightmap, const std::vector<Triangulator::PackedPoint>& vertices,
+        const std::vector<uint32_t>& indices, size_t clusterCount);
+
+    // adds the per LOD totals to the report and saves density_lod<N>.png into dir
+    void Finish(const std::filesystem::path& dir) const;
+
+    static constexpr unsigned CacheSize = 16;
+    static constexpr int DensityCells = 16;     // density cells along a patch side
+
+private:
+    struct Totals
+    {
+        double Triangles = 0.0;
+        double Vertices = 0.0;
+        double Transformed = 0.0;
+        double BytesFetched = 0.0;
+        double PixelsCovered = 0.0;
+        double PixelsShaded = 0.0;
+        double StripIndices = 0.0;
+        double Clusters = 0.0;
+        double IndexBytes = 0.0;    // at the width the LOD is stored with
+        double Patches = 0.0;
+    };
+
+    BuildReport& m_Report;
+    const int m_Nx;
+    const int m_Ny;
+    const float m_HeightScale;
+    std::vector<Totals> m_Totals;                   // per LOD
+    std::vector<std::vector<uint32_t>> m_Density;   // per LOD, triangles per cell by centroid
+    mutable std::mutex m_Mutex;
+};
@@ -0,0 +1,292 @@
+#include "MeshValidator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <mutex>
+
+#include "Parallel.h"
+
+namespace
+{
+    constexpr int Last = 255;
+    constexpr int Facing[4] = { 1, 0, 3, 2 };
+    const char* const SideNames[4] = { "left", "right", "top", "bottom" };
+
+    int Side(const Triangulator::PackedPoint p, const int side)
+    {
+        switch (side)
+        {
+        case 0: return p.PosX == 0 ? p.PosY : -1;
+        case 1: return p.PosX == Last ? p.PosY : -1;
+        case 2: return p.PosY == 0 ? p.PosX : -1;
+        default: return p.PosY == Last ? p.PosX : -1;
+        }
+    }
+
+    std::string Name(const int x, const int y, const int lod)
+    {
+        return "patch " + std::to_string(x) + "_" + std::to_string(y) + " lod " + std::to_string(lod);
+    }
+
+    void Merge(MeshValidator::Result& into, MeshValidator::Result& from)
+    {
+        into.Patches += from.Patches;
+        into.Edges += from.Edges;
+        into.Triangles += from.Triangles;
+        into.Errors += from.Errors;
+        for (size_t i = 0; i < from.MaxDeviation.size(); ++i)
+            into.MaxDeviation[i] = std::max(into.MaxDeviation[i], from.MaxDeviation[i]);
+        for (auto& message : from.Messages)
+            if (into.Messages.size() < MeshValidator::MaxMessages) into.Messages.push_back(std::move(message));
+    }
+}
+
+MeshValidator::MeshValidator(const int nx, const int ny, std::vector<float> lodErrors) :
+    m_Nx(nx), m_Ny(ny), m_LodErrors(std::move(lodErrors))
+{
+}
+
+MeshValidator::Result MeshValidator::Run(const PatchSource& patches, const HeightSource& heights) const
+{
+    const int lodCount = static_cast<int>(m_LodErrors.size());
+    Result result;
+    result.MaxDeviation.assign(lodCount, 0.0f);
+    std::mutex mutex;
+
+    // every patch on its own, keeping only the borders for the edges
+    std::vector<Patch> checked(static_cast<size_t>(m_Nx) * m_Ny);
+    const int n = m_Nx * m_Ny;
+    ParallelFor(0, n, ParallelGrain(n), [&](const int begin, const int end)
+    {
+        Result local;
+        local.MaxDeviation.assign(lodCount, 0.0f);
+        for (int i = begin; i < end; ++i)
+        {
+            const int x = i % m_Nx;
+            const int y = i / m_Nx;
+            auto& patch = checked[i];
+            const auto lods = patches(x, y);
+            // a fully masked patch has no meshes and no edges to check
+            if (lods.empty()) continue;
+            patch.Borders.resize(lodCount);
+            patch.Strips.resize(lodCount);
+            if (static_cast<int>(lods.size()) != lodCount)
+            {
+                Fail(local, Name(x, y, 0) + ": " + std::to_string(lods.size()) + " LODs");
+                continue;
+            }
+            const auto patchHeights = heights(x, y);
+            for (int lod = 0; lod < lodCount; ++lod)
+                CheckLod(x, y, lod, lods[lod], *patchHeights, patch, local);
+            ++local.Patches;
+        }
+        std::lock_guard lock(mutex);
+        Merge(result, local);
+    });
+
+    // then every shared edge for every pair of LODs, (x, y) on the left or top of it
+    const int horizontal = (m_Nx - 1) * m_Ny;
+    const int edges = horizontal + m_Nx * (m_Ny - 1);
+    ParallelFor(0, edges, ParallelGrain(edges), [&](const int begin, const int end)
+    {
+        Result local;
+        local.MaxDeviation.assign(lodCount, 0.0f);
+        for (int e = begin; e < end; ++e)
+        {
+            const bool across = e < horizontal;
+            const int x = across ? e % (m_Nx - 1) : (e - horizontal) % m_Nx;
+            const int y = across ? e / (m_Nx - 1) : (e - horizontal) / m_Nx;
+            const int nx = across ? x + 1 : x;
+            const int ny = across ? y : y + 1;
+            const int side = across ? 1 : 3;
+            const auto& a = checked[static_cast<size_t>(y) * m_Nx + x];
+            const auto& b = checked[static_cast<size_t>(ny) * m_Nx + nx];
+            for (int la = 0; la < lodCount; ++la)
+            {
+                for (int lb = 0; lb < lodCount; ++lb)
+                {
+                    if (la <= lb)
+                        CheckEdge(x, y, side, a, la, b, lb, local);
+                    else
+                        CheckEdge(nx, ny, Facing[side], b, lb, a, la, local);
+                }
+            }
+            ++local.Edges;
+        }
+        std::lock_guard lock(mutex);
+        Merge(result, local);
+    });
+    return result;
+}
+
+void MeshValidator::CheckLod(const int x, const int y, const int lod, const Lod& mesh, const Heightmap& heights,
+    Patch& patch, Result& result) const
+{
+    const auto& vertices = mesh.Vertices;
+    const auto& indices = mesh.Indices;
+    const uint32_t surface = PatchArchive::SurfaceIndexCount(static_cast<uint32_t>(indices.size()),
+        mesh.Stitches.data(), static_cast<uint32_t>(mesh.Stitches.size()));
+    if (indices.size() % 3 != 0 || surface % 3 != 0 || surface > indices.size())
+    {
+        Fail(result, Name(x, y, lod) + ": index count " + std::to_string(indices.size()));
+        return;
+    }
+    const auto outside = std::find_if(indices.begin(), indices.end(), [&vertices](const uint32_t i)
+    {
+        return i >= vertices.size();
+    });
+    if (outside != indices.end())
+    {
+        Fail(result, Name(x, y, lod) + ": index " + std::to_string(*outside) + " past " +
+            std::to_string(vertices.size()) + " vertices");
+        return;
+    }
+
+    // The triangulator gives every triangle a negative signed area in pixel space, the viewer culls the
+    // others. Inside a triangle the surface has to stay within the error the LOD was built for. The cut
+    // re-fans the triangles on the border to the neighbour's rivets, which sit at their exact heights up to
+    // that error off the old triangle's plane, so there the bound is twice the error.
+    const float error = m_LodErrors[lod];
+    float deviation = 0.0f;
+    uint64_t degenerate = 0, flipped = 0, deviating = 0;
+    float worstExcess = 0.0f, worstBound = error;
+    for (uint32_t t = 0; t < surface; t += 3)
+    {
+        const auto p0 = vertices[indices[t]];
+        const auto p1 = vertices[indices[t + 1]];
+        const auto p2 = vertices[indices[t + 2]];
+        const int x0 = p0.PosX, y0 = p0.PosY;
+        const int x1 = p1.PosX, y1 = p1.PosY;
+        const int x2 = p2.PosX, y2 = p2.PosY;
+        const int area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0) { ++degenerate; continue; }
+        if (area > 0) ++flipped;
+
+        const float h0 = heights.At(x0, y0);
+        const float h1 = heights.At(x1, y1);
+        const float h2 = heights.At(x2, y2);
+        const int minX = std::min({ x0, x1, x2 }), maxX = std::max({ x0, x1, x2 });
+        const int minY = std::min({ y0, y1, y2 }), maxY = std::max({ y0, y1, y2 });
+        const float inverse = 1.0f / static_cast<float>(area);
+        float triangleDeviation = 0.0f;
+        for (int py = minY; py <= maxY; ++py)
+        {
+            for (int px = minX; px <= maxX; ++px)
+            {
+                // barycentric weights, all of one sign inside whichever way the triangle winds
+                const int w0 = (x1 - px) * (y2 - py) - (y1 - py) * (x2 - px);
+                const int w1 = (x2 - px) * (y0 - py) - (y2 - py) * (x0 - px);
+                const int w2 = (x0 - px) * (y1 - py) - (y0 - py) * (x1 - px);
+                if ((w0 < 0 || w1 < 0 || w2 < 0) && (w0 > 0 || w1 > 0 || w2 > 0)) continue;
+                if (heights.Masked(px, py)) continue;
+                const float z = (w0 * h0 + w1 * h1 + w2 * h2) * inverse;
+                triangleDeviation = std::max(triangleDeviation, std::abs(z - heights.At(px, py)));
+            }
+        }
+        deviation = std::max(deviation, triangleDeviation);
+
+        const bool border = minX == 0 || minY == 0 || maxX == Last || maxY == Last;
+        const float bound = border ? 2.0f * error : error;
+        // a little slack for the float interpolation
+        if (triangleDeviation > bound + 1e-6f)
+        {
+            ++deviating;
+            if (triangleDeviation - bound > worstExcess)
+            {
+                worstExcess = triangleDeviation - bound;
+                worstBound = bound;
+            }
+        }
+    }
+    result.Triangles += surface / 3;
+    result.MaxDeviation[lod] = std::max(result.MaxDeviation[lod], deviation);
+    if (degenerate)
+        Fail(result, Name(x, y, lod) + ": " + std::to_string(degenerate) + " degenerate triangles");
+    if (flipped)
+        Fail(result, Name(x, y, lod) + ": " + std::to_string(flipped) + " flipped triangles");
+    if (deviating)
+        Fail(result, Name(x, y, lod) + ": " + std::to_string(deviating) + " triangles deviate from the heightmap, up to " +
+            std::to_string(worstBound + worstExcess) + " where " + std::to_string(worstBound) + " is allowed");
+
+    auto& borders = patch.Borders[lod];
+    for (const auto& v : vertices)
+        for (int side = 0; side < 4; ++side)
+            if (const int k = Side(v, side); k >= 0) borders[side].push_back(static_cast<uint8_t>(k));
+    for (auto& border : borders)
+    {
+        std::sort(border.begin(), border.end());
+        if (std::adjacent_find(border.begin(), border.end()) != border.end())
+            Fail(result, Name(x, y, lod) + ": duplicate border vertices");
+        border.erase(std::unique(border.begin(), border.end()), border.end());
+    }
+
+    for (const auto& stitch : mesh.Stitches)
+    {
+        if (stitch.Side >= 4 || stitch.IndexOffset < surface || stitch.IndexCount % 3 != 0 ||
+            static_cast<uint64_t>(stitch.IndexOffset) + stitch.IndexCount > indices.size())
+        {
+            Fail(result, Name(x, y, lod) + ": stitch out of range");
+            continue;
+        }
+        Strip strip { stitch, {} };
+        for (uint32_t i = stitch.IndexOffset; i < stitch.IndexOffset + stitch.IndexCount; ++i)
+        {
+            const int k = Side(vertices[indices[i]], static_cast<int>(stitch.Side));
+            if (k < 0)
+            {
+                Fail(result, Name(x, y, lod) + ": stitch vertex off the " + SideNames[stitch.Side] + " side");
+                break;
+            }
+            strip.Positions.push_back(static_cast<uint8_t>(k));
+        }
+        std::sort(strip.Positions.begin(), strip.Positions.end());
+        strip.Positions.erase(std::unique(strip.Positions.begin(), strip.Positions.end()), strip.Positions.end());
+        patch.Strips[lod].push_back(std::move(strip));
+    }
+}
+
+void MeshValidator::CheckEdge(const int x, const int y, const int side, const Patch& fine, const int fineLod,
+    const Patch& coarse, const int coarseLod, Result& result) const
+{
+    if (fine.Borders.empty() || coarse.Borders.empty()) return;
+    const auto& f = fine.Borders[fineLod][side];
+    const auto& c = coarse.Borders[coarseLod][Facing[side]];
+    const std::string where = Name(x, y, fineLod) + " " + SideNames[side] + " against lod " + std::to_string(coarseLod);
+
+    if (fineLod == coarseLod)
+    {
+        if (f != c) Fail(result, where + ": borders differ");
+        return;
+    }
+    if (!std::includes(f.begin(), f.end(), c.begin(), c.end()))
+    {
+        Fail(result, where + ": coarse border is not a subset");
+        return;
+    }
+
+    std::vector<uint8_t> fineOnly;
+    std::set_difference(f.begin(), f.end(), c.begin(), c.end(), std::back_inserter(fineOnly));
+    const auto& strips = fine.Strips[fineLod];
+    const auto strip = std::find_if(strips.begin(), strips.end(), [side, coarseLod](const Strip& s)
+    {
+        return static_cast<int>(s.Stitch.Side) == side && static_cast<int>(s.Stitch.NeighbourLod) == coarseLod;
+    });
+    if (strip == strips.end())
+    {
+        if (!fineOnly.empty())
+            Fail(result, where + ": " + std::to_string(fineOnly.size()) + " T-junctions without a strip");
+        return;
+    }
+    // the strip may only use border vertices, and has to reach every one the coarse side lacks
+    const auto& used = strip->Positions;
+    if (!std::includes(f.begin(), f.end(), used.begin(), used.end()) ||
+        !std::includes(used.begin(), used.end(), fineOnly.begin(), fineOnly.end()))
+        Fail(result, where + ": strip does not close the seam");
+}
+
+void MeshValidator::Fail(Result& result, const std::string& message)
+{
+    ++result.Errors;
+    if (result.Messages.size() < MaxMessages) result.Messages.push_back(message);
+}
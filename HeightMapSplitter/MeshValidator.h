@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "heightmap.h"
+#include "PatchArchive.h"
+#include "triangulator.h"
+
+// Checks the finished patch meshes of a whole grid. Every LOD of every patch is checked on its own for
+// index bounds, degenerate and flipped triangles and how far it strays from the heightmap's unmasked
+// pixels: within the LOD's error inside the patch, twice that on the triangles the cut re-fanned to the
+// rivets on its border. Then every shared edge is checked for every pair of LODs the viewer may put next to
+// each other, comparing the sorted border vertices of both sides. The same LOD has to match exactly. A
+// coarser LOD has to be a subset of the finer one, and the finer side's strip for it has to cover exactly
+// the difference.
+class MeshValidator
+{
+public:
+    struct Lod
+    {
+        std::vector<Triangulator::PackedPoint> Vertices;
+        std::vector<uint32_t> Indices;  // surface, then the stitching strips
+        std::vector<PatchArchive::Stitch> Stitches;
+    };
+
+    // every LOD of patch (x, y) as saved, lod 0 first, none for a fully masked patch
+    using PatchSource = std::function<std::vector<Lod>(int x, int y)>;
+    using HeightSource = std::function<std::shared_ptr<const Heightmap>(int x, int y)>;
+
+    struct Result
+    {
+        int Patches = 0;
+        int Edges = 0;
+        uint64_t Triangles = 0;
+        uint64_t Errors = 0;
+        std::vector<float> MaxDeviation;    // per LOD, normalized heights
+        std::vector<std::string> Messages;  // the first few errors
+
+        [[nodiscard]] bool Ok() const { return Errors == 0; }
+    };
+
+    // lodErrors holds the error each LOD was refined down to, lod 0 first
+    MeshValidator(int nx, int ny, std::vector<float> lodErrors);
+
+    [[nodiscard]] Result Run(const PatchSource& patches, const HeightSource& heights) const;
+
+    static constexpr size_t MaxMessages = 32;
+
+private:
+    // sorted positions along each side, left, right, top, bottom as EdgeMask::Side
+    using Border = std::array<std::vector<uint8_t>, 4>;
+
+    struct Strip
+    {
+        PatchArchive::Stitch Stitch;
+        std::vector<uint8_t> Positions;     // sorted, where the strip's vertices sit along its side
+    };
+
+    struct Patch
+    {
+        std::vector<Border> Borders;                // per LOD
+        std::vector<std::vector<Strip>> Strips;     // per LOD
+    };
+
+    void CheckLod(int x, int y, int lod, const Lod& mesh, const Heightmap& heights, Patch& patch,
+        Result& result) const;
+    void CheckEdge(int x, int y, int side, const Patch& fine, int fineLod, const Patch& coarse, int coarseLod,
+        Result& result) const;
+    static void Fail(Result& result, const std::string& message);
+
+    const int m_Nx;
+    const int m_Ny;
+    const std::vector<float> m_LodErrors;
+};
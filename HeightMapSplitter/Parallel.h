@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "ThreadPool.h"
+
+// Split [begin, end) into chunks of `grain` and run f(chunkBegin, chunkEnd) on g_ThreadPool.
+// The calling thread claims chunks as well and only waits for chunks that are already running,
+// so it is safe to call from inside a pool worker.
+template <class F>
+void ParallelFor(const int begin, const int end, int grain, F&& f)
+{
+    if (end <= begin) return;
+    grain = std::max(grain, 1);
+    const int chunkCount = (end - begin + grain - 1) / grain;
+    if (chunkCount == 1)
+    {
+        f(begin, end);
+        return;
+    }
+
+    struct State
+    {
+        std::atomic<int> Next { 0 };
+        std::atomic<int> Done { 0 };
+        std::mutex Mutex;
+        std::condition_variable Cv;
+        std::exception_ptr Error;
+    };
+    const auto state = std::make_shared<State>();
+
+    auto work = [state, begin, end, grain, chunkCount, &f]
+    {
+        for (int c = state->Next++; c < chunkCount; c = state->Next++)
+        {
+            try
+            {
+                const int b = begin + c * grain;
+                f(b, std::min(b + grain, end));
+            }
+            catch (...)
+            {
+                std::lock_guard lock(state->Mutex);
+                if (!state->Error) state->Error = std::current_exception();
+            }
+            if (++state->Done == chunkCount)
+            {
+                std::lock_guard lock(state->Mutex);
+                state->Cv.notify_all();
+            }
+        }
+    };
+
+    const int helpers = std::min<int>(chunkCount - 1, std::thread::hardware_concurrency());
+    for (int i = 0; i < helpers; ++i)
+        g_ThreadPool.enqueue(work);
+    work();
+
+    std::unique_lock lock(state->Mutex);
+    state->Cv.wait(lock, [&state, chunkCount] { return state->Done == chunkCount; });
+    if (state->Error) std::rethrow_exception(state->Error);
+}
+
+// Grain that gives every worker a few chunks to balance uneven rows.
+inline int ParallelGrain(const int count, const int chunksPerThread = 4)
+{
+    const int chunks = std::max<int>(1, std::thread::hardware_concurrency() * chunksPerThread);
+    return std::max(1, (count + chunks - 1) / chunks);
+}
@@ -0,0 +1,156 @@
+#include "PatchArchive.h"
+
+#include "AsyncWriter.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+PatchArchiveWriter::PatchArchiveWriter(const std::filesystem::path& path, const int patchNx, const int patchNy,
+    const int lodCount, const uint32_t vertexStride, const float heightScale, const bool compress, AsyncWriter* writer) :
+    m_File(path, std::ios::binary | std::ios::out | std::ios::trunc), m_Path(path), m_Compress(compress),
+    m_Writer(writer)
+{
+    if (!m_File)
+        throw std::runtime_error("failed to open " + path.u8string());
+    if (patchNx <= 0 || patchNy <= 0 || lodCount <= 0)
+        throw std::runtime_error("invalid patch archive layout");
+
+    m_Header.Magic = PatchArchive::Magic;
+    m_Header.Version = PatchArchive::Version;
+    m_Header.PatchNx = patchNx;
+    m_Header.PatchNy = patchNy;
+    m_Header.LodCount = lodCount;
+    m_Header.VertexStride = vertexStride;
+    m_Header.HeightScale = heightScale;
+    m_Header.EntryOffset = PatchArchive::Align(sizeof(PatchArchive::Header));
+    m_Entries.resize(static_cast<size_t>(patchNx) * patchNy * lodCount);
+
+    // header and table are written last, payloads start right behind the space they take
+    m_End = PatchArchive::Align(m_Header.EntryOffset + m_Entries.size() * sizeof(PatchArchive::Entry));
+    m_File.seekp(static_cast<std::streamoff>(m_End));
+}
+
+uint64_t PatchArchiveWriter::Append(const void* data, const uint64_t size)
+{
+    static constexpr char Padding[PatchArchive::Alignment] {};
+    const uint64_t offset = m_End;
+    m_File.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_End = PatchArchive::Align(offset + size);
+    m_File.write(Padding, static_cast<std::streamsize>(m_End - offset - size));
+    return offset;
+}
+
+void PatchArchiveWriter::Add(const int x, const int y, const int lod, const float error,
+    const void* vertices, const uint32_t vertexCount, const void* indices, const uint32_t indexCount,
+    const uint32_t indexWidth, std::vector<PatchArchive::Cluster> clusters, std::vector<PatchArchive::Stitch> stitches)
+{
+    if (x < 0 || y < 0 || lod < 0 ||
+        x >= static_cast<int>(m_Header.PatchNx) || y >= static_cast<int>(m_Header.PatchNy) ||
+        lod >= static_cast<int>(m_Header.LodCount))
+        throw std::runtime_error("patch out of archive range");
+
+    const uint32_t stride = m_Header.VertexStride;
+    const size_t rawVertexBytes = static_cast<size_t>(vertexCount) * stride;
+    const size_t rawIndexBytes = static_cast<size_t>(indexCount) * indexWidth;
+
+    std::vector<uint8_t> vertexStream, indexStream;
+    if (m_Compress && indexCount % 3 == 0)
+    {
+        const uint32_t group = PatchArchive::VertexGroup(stride);
+        const uint32_t count = (vertexCount + group - 1) / group;
+        std::vector<uint8_t> grouped(static_cast<size_t>(count) * group * stride);
+        std::memcpy(grouped.data(), vertices, rawVertexBytes);
+        for (uint32_t i = vertexCount; i < count * group; ++i)
+            std::memcpy(grouped.data() + static_cast<size_t>(i) * stride, grouped.data() + rawVertexBytes - stride, stride);
+
+        vertexStream.resize(meshopt_encodeVertexBufferBound(count, stride * group));
+        vertexStream.resize(meshopt_encodeVertexBuffer(
+            vertexStream.data(), vertexStream.size(), grouped.data(), count, stride * group));
+
+        indexStream.resize(meshopt_encodeIndexBufferBound(indexCount, vertexCount));
+        indexStream.resize(indexWidth == sizeof(uint16_t)
+            ? meshopt_encodeIndexBuffer(indexStream.data(), indexStream.size(),
+                static_cast<const uint16_t*>(indices), indexCount)
+            : meshopt_encodeIndexBuffer(indexStream.data(), indexStream.size(),
+                static_cast<const uint32_t*>(indices), indexCount));
+    }
+
+    // keep raw whatever did not encode or did not get smaller
+    const bool encoded = !vertexStream.empty() && !indexStream.empty() &&
+        vertexStream.size() + indexStream.size() < rawVertexBytes + rawIndexBytes;
+    if (!encoded)
+    {
+        vertexStream.assign(static_cast<const uint8_t*>(vertices), static_cast<const uint8_t*>(vertices) + rawVertexBytes);
+        indexStream.assign(static_cast<const uint8_t*>(indices), static_cast<const uint8_t*>(indices) + rawIndexBytes);
+    }
+
+    if (!m_Writer)
+    {
+        Store(x, y, lod, error, vertexCount, indexCount, indexWidth, encoded, vertexStream, indexStream, clusters,
+            stitches);
+        return;
+    }
+    const size_t bytes = vertexStream.size() + indexStream.size() + clusters.size() * sizeof(PatchArchive::Cluster) +
+        stitches.size() * sizeof(PatchArchive::Stitch);
+    m_Writer->Post([=, v = std::move(vertexStream), i = std::move(indexStream), c = std::move(clusters),
+        st = std::move(stitches)]
+    {
+        Store(x, y, lod, error, vertexCount, indexCount, indexWidth, encoded, v, i, c, st);
+    }, bytes);
+}
+
+void PatchArchiveWriter::AddEmpty(const int x, const int y, const int lod, const float error)
+{
+    if (x < 0 || y < 0 || lod < 0 ||
+        x >= static_cast<int>(m_Header.PatchNx) || y >= static_cast<int>(m_Header.PatchNy) ||
+        lod >= static_cast<int>(m_Header.LodCount))
+        throw std::runtime_error("patch out of archive range");
+
+    std::lock_guard lock(m_Mutex);
+    auto& entry = m_Entries[(static_cast<size_t>(y) * m_Header.PatchNx + x) * m_Header.LodCount + lod];
+    entry.Error = error;
+    entry.Flags = PatchArchive::Empty;
+}
+
+void PatchArchiveWriter::Store(const int x, const int y, const int lod, const float error,
+    const uint32_t vertexCount, const uint32_t indexCount, const uint32_t indexWidth, const bool encoded,
+    const std::vector<uint8_t>& vertices, const std::vector<uint8_t>& indices,
+    const std::vector<PatchArchive::Cluster>& clusters, const std::vector<PatchArchive::Stitch>& stitches)
+{
+    std::lock_guard lock(m_Mutex);
+    auto& entry = m_Entries[(static_cast<size_t>(y) * m_Header.PatchNx + x) * m_Header.LodCount + lod];
+    entry.VertexOffset = Append(vertices.data(), vertices.size());
+    entry.IndexOffset = Append(indices.data(), indices.size());
+    entry.ClusterOffset = clusters.empty() ? 0 : Append(clusters.data(), clusters.size() * sizeof(PatchArchive::Cluster));
+    entry.ClusterCount = static_cast<uint32_t>(clusters.size());
+    entry.StitchOffset = stitches.empty() ? 0 : Append(stitches.data(), stitches.size() * sizeof(PatchArchive::Stitch));
+    entry.StitchCount = static_cast<uint32_t>(stitches.size());
+    entry.VertexCount = vertexCount;
+    entry.IndexCount = indexCount;
+    entry.VertexBytes = static_cast<uint32_t>(vertices.size());
+    entry.IndexBytes = static_cast<uint32_t>(indices.size());
+    entry.IndexWidth = indexWidth;
+    entry.Codec = encoded ? PatchArchive::Meshopt : PatchArchive::Raw;
+    entry.Error = error;
+    m_RawBytes += static_cast<uint64_t>(vertexCount) * m_Header.VertexStride + static_cast<uint64_t>(indexCount) * indexWidth;
+    m_StoredBytes += vertices.size() + indices.size();
+}
+
+void PatchArchiveWriter::Finish()
+{
+    if (m_Writer) m_Writer->Flush();
+    std::lock_guard lock(m_Mutex);
+    m_Header.FileSize = m_End;
+    m_File.seekp(0);
+    m_File.write(reinterpret_cast<const char*>(&m_Header), sizeof(m_Header));
+    m_File.seekp(static_cast<std::streamoff>(m_Header.EntryOffset));
+    m_File.write(reinterpret_cast<const char*>(m_Entries.data()),
+        static_cast<std::streamsize>(m_Entries.size() * sizeof(PatchArchive::Entry)));
+    m_File.close();
+    if (!m_File)
+        throw std::runtime_error("failed to write " + m_Path.u8string());
+    std::printf("%s generated, meshes %.1f MB stored in %.1f MB (%.2fx)\n", m_Path.u8string().c_str(),
+        m_RawBytes / 1048576.0, m_StoredBytes / 1048576.0,
+        m_StoredBytes ? static_cast<double>(m_RawBytes) / m_StoredBytes : 1.0);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <meshoptimizer.h>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+class AsyncWriter;
+
+// patches.pak: every LOD of every mesh patch in one file the viewer maps and reads in place.
+// Header, then the entry table, then the payloads, each starting on an Alignment boundary.
+// Entry (x, y, lod) sits at index (y * PatchNx + x) * LodCount + lod, a zero VertexCount marks a hole
+// unless the entry is flagged Empty: a patch left without meshes on purpose, such as a fully masked one.
+// Payloads are either raw or meshopt encoded, per entry. Every LOD also carries its cluster table,
+// raw, with the index buffer ordered cluster by cluster, followed by the LOD's stitching strips.
+namespace PatchArchive
+{
+    constexpr uint32_t Magic = 0x4b415054; // "TPAK"
+    // 5 and older leave masked patches as holes, 4 and older may carry the per-LOD errors coarsest first
+    constexpr uint32_t Version = 6;
+    constexpr uint64_t Alignment = 64;
+    constexpr uint32_t ClusterVertices = 64;
+    constexpr uint32_t ClusterTriangles = 124;
+
+    enum Codec : uint32_t
+    {
+        Raw = 0,
+        Meshopt = 1,    // meshopt vertex codec over vertex pairs, meshopt index codec
+    };
+
+    enum EntryFlags : uint32_t
+    {
+        Empty = 1,      // no mesh to draw, not missing
+    };
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t PatchNx;
+        uint32_t PatchNy;
+        uint32_t LodCount;
+        uint32_t VertexStride;
+        uint64_t EntryOffset;
+        uint64_t FileSize;
+        float HeightScale;      // vertical scale the cluster bounds and cones were computed with
+        uint32_t Reserved;
+    };
+
+    struct Entry
+    {
+        uint64_t VertexOffset;
+        uint64_t IndexOffset;
+        uint64_t ClusterOffset;
+        uint32_t VertexCount;
+        uint32_t IndexCount;
+        uint32_t VertexBytes;   // stored sizes, smaller than count * width when encoded
+        uint32_t IndexBytes;
+        uint32_t IndexWidth;    // 2 or 4 bytes
+        uint32_t Codec;
+        float Error;            // geometric error the LOD was built for
+        uint32_t ClusterCount;
+        uint64_t StitchOffset;
+        uint32_t StitchCount;
+        uint32_t Flags;         // EntryFlags
+    };
+
+    // Patch local, x and z in pixels, y in heights times Header::HeightScale. The cone follows the
+    // meshopt convention: the cluster faces away from an eye where
+    // dot(Center - eye, ConeAxis) >= ConeCutoff * length(Center - eye) + Radius.
+    struct Cluster
+    {
+        float Center[3];
+        float Radius;
+        float ConeAxis[3];
+        float ConeCutoff;
+        float MinHeight;        // normalized heights, unscaled
+        float MaxHeight;
+        uint32_t IndexOffset;
+        uint32_t TriangleCount;
+    };
+
+    // A LOD's border only carries the vertices its own LOD and the same LOD of the neighbours need. Next
+    // to a coarser neighbour the extra border vertices leave T-junctions, the strip for that side and
+    // neighbour LOD closes them with vertical triangles between the fine border and the coarse one.
+    // Offsets are into the LOD's index buffer, behind the surface triangles.
+    struct Stitch
+    {
+        uint32_t Side;          // EdgeMask::Side, left, right, top, bottom
+        uint32_t NeighbourLod;  // always coarser than the LOD the strip belongs to
+        uint32_t IndexOffset;
+        uint32_t IndexCount;
+    };
+
+    static_assert(sizeof(Header) == 48 && sizeof(Entry) == 72 && sizeof(Cluster) == 48 && sizeof(Stitch) == 16,
+        "packed on disk as is");
+
+    // index count of the surface alone, without the strips behind it
+    inline uint32_t SurfaceIndexCount(const uint32_t indexCount, const Stitch* stitches, const uint32_t stitchCount)
+    {
+        return stitchCount ? stitches[0].IndexOffset : indexCount;
+    }
+
+    constexpr uint64_t Align(const uint64_t offset)
+    {
+        return (offset + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    // The meshopt vertex codec wants strides in multiples of 4, so 2 byte vertices are coded in pairs,
+    // an odd count repeats its last vertex. out receives vertexCount * stride bytes.
+    inline uint32_t VertexGroup(const uint32_t stride)
+    {
+        return stride % 4 == 0 ? 1 : stride % 2 == 0 ? 2 : 4;
+    }
+
+    inline void DecodeVertices(void* out, const uint32_t vertexCount, const uint32_t stride,
+        const void* data, const size_t size)
+    {
+        const uint32_t group = VertexGroup(stride);
+        const uint32_t count = (vertexCount + group - 1) / group;
+        std::vector<uint8_t> padded;
+        void* target = out;
+        if (count * group != vertexCount)
+        {
+            padded.resize(static_cast<size_t>(count) * group * stride);
+            target = padded.data();
+        }
+        if (meshopt_decodeVertexBuffer(target, count, stride * group, static_cast<const uint8_t*>(data), size) != 0)
+            throw std::runtime_error("corrupt vertex stream");
+        if (target != out)
+            std::copy_n(padded.data(), static_cast<size_t>(vertexCount) * stride, static_cast<uint8_t*>(out));
+    }
+
+    inline void DecodeIndices(void* out, const uint32_t indexCount, const uint32_t indexWidth,
+        const void* data, const size_t size)
+    {
+        if (meshopt_decodeIndexBuffer(out, indexCount, indexWidth, static_cast<const uint8_t*>(data), size) != 0)
+            throw std::runtime_error("corrupt index stream");
+    }
+}
+
+// Streams payloads to the end of the archive in whatever order patches finish, then writes the
+// entry table into the space reserved after the header. Add() is safe to call from any thread,
+// encoding runs on the calling thread, the append is handed to the writer when there is one.
+class PatchArchiveWriter
+{
+public:
+    PatchArchiveWriter(const std::filesystem::path& path, int patchNx, int patchNy, int lodCount,
+        uint32_t vertexStride, float heightScale, bool compress = true, AsyncWriter* writer = nullptr);
+
+    void Add(int x, int y, int lod, float error,
+        const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount, uint32_t indexWidth,
+        std::vector<PatchArchive::Cluster> clusters = {}, std::vector<PatchArchive::Stitch> stitches = {});
+
+    // an entry that is there without a mesh, for every LOD of a fully masked patch
+    void AddEmpty(int x, int y, int lod, float error);
+
+    // waits for pending appends and writes the header and table, the archive is incomplete until then
+    void Finish();
+
+private:
+    uint64_t Append(const void* data, uint64_t size);
+    void Store(int x, int y, int lod, float error, uint32_t vertexCount, uint32_t indexCount, uint32_t indexWidth,
+        bool encoded, const std::vector<uint8_t>& vertices, const std::vector<uint8_t>& indices,
+        const std::vector<PatchArchive::Cluster>& clusters, const std::vector<PatchArchive::Stitch>& stitches);
+
+    std::ofstream m_File;
+    std::filesystem::path m_Path;
+    PatchArchive::Header m_Header {};
+    const bool m_Compress;
+    AsyncWriter* const m_Writer;
+    std::vector<PatchArchive::Entry> m_Entries;
+    uint64_t m_End = 0;
+    uint64_t m_RawBytes = 0;
+    uint64_t m_StoredBytes = 0;
+    std::mutex m_Mutex;
+};
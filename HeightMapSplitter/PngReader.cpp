@@ -0,0 +1,164 @@
+#include "PngReader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    uint32_t GetU32(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+            static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+
+    uint8_t Paeth(const int a, const int b, const int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+}
+
+std::unique_ptr<PngReader> PngReader::Open(const std::filesystem::path& path)
+{
+    std::unique_ptr<PngReader> reader(new PngReader(path));
+    if (!reader->ReadHeader()) return nullptr;
+    return reader;
+}
+
+PngReader::PngReader(const std::filesystem::path& path) :
+    m_File(path, std::ios::binary | std::ios::in), m_Path(path) {}
+
+PngReader::~PngReader()
+{
+    if (m_Inflating) inflateEnd(&m_Stream);
+}
+
+bool PngReader::ReadHeader()
+{
+    static constexpr uint8_t Signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t signature[sizeof(Signature)] {};
+    if (!m_File.read(reinterpret_cast<char*>(signature), sizeof(signature)) ||
+        std::memcmp(signature, Signature, sizeof(Signature)) != 0)
+        return false;
+
+    uint32_t length;
+    char type[4];
+    if (!NextChunk(length, type) || std::memcmp(type, "IHDR", 4) != 0 || length != 13) return false;
+    uint8_t ihdr[13];
+    if (!m_File.read(reinterpret_cast<char*>(ihdr), sizeof(ihdr))) return false;
+    m_File.ignore(4);
+
+    // palettes, bit depths below 8 and interlacing are left to whoever loads the image whole
+    static constexpr int Channels[] = { 1, 0, 3, 0, 2, 0, 4 };
+    const int colorType = ihdr[9];
+    m_Width = static_cast<int>(GetU32(ihdr));
+    m_Height = static_cast<int>(GetU32(ihdr + 4));
+    m_BitDepth = ihdr[8];
+    m_Channels = colorType < 7 ? Channels[colorType] : 0;
+    if (m_Width <= 0 || m_Height <= 0 || m_Channels == 0 || (m_BitDepth != 8 && m_BitDepth != 16) ||
+        ihdr[10] != 0 || ihdr[11] != 0 || ihdr[12] != 0)
+        return false;
+
+    // everything up to the first IDAT, a gamma or a text chunk, says nothing about the samples
+    while (NextChunk(length, type))
+    {
+        if (std::memcmp(type, "IDAT", 4) == 0)
+        {
+            m_ChunkLeft = length;
+            break;
+        }
+        if (std::memcmp(type, "IEND", 4) == 0) return false;
+        m_File.ignore(static_cast<std::streamsize>(length) + 4);
+    }
+    if (!m_File) return false;
+
+    if (inflateInit(&m_Stream) != Z_OK)
+        throw std::runtime_error("inflateInit failed");
+    m_Inflating = true;
+    m_RowBytes = static_cast<size_t>(m_Width) * m_Channels * m_BitDepth / 8;
+    m_Row.resize(m_RowBytes + 1);
+    m_Prev.assign(m_RowBytes, 0);
+    m_In.resize(1 << 16);
+    return true;
+}
+
+bool PngReader::NextChunk(uint32_t& length, char type[4])
+{
+    uint8_t header[8];
+    if (!m_File.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+    length = GetU32(header);
+    std::memcpy(type, header + 4, 4);
+    return true;
+}
+
+void PngReader::Refill()
+{
+    // the image data may be cut into any number of IDATs, they are one zlib stream
+    while (m_ChunkLeft == 0)
+    {
+        uint32_t length;
+        char type[4];
+        m_File.ignore(4);
+        if (!NextChunk(length, type) || std::memcmp(type, "IDAT", 4) != 0)
+            throw std::runtime_error("truncated png " + m_Path.u8string());
+        m_ChunkLeft = length;
+    }
+
+    const uint32_t n = std::min<uint32_t>(m_ChunkLeft, static_cast<uint32_t>(m_In.size()));
+    if (!m_File.read(reinterpret_cast<char*>(m_In.data()), n))
+        throw std::runtime_error("truncated png " + m_Path.u8string());
+    m_ChunkLeft -= n;
+    m_Stream.next_in = m_In.data();
+    m_Stream.avail_in = n;
+}
+
+const uint8_t* PngReader::ReadRow()
+{
+    if (m_Y >= m_Height)
+        throw std::runtime_error("read past the last row of " + m_Path.u8string());
+
+    m_Stream.next_out = m_Row.data();
+    m_Stream.avail_out = static_cast<uInt>(m_Row.size());
+    while (m_Stream.avail_out > 0)
+    {
+        if (m_Stream.avail_in == 0) Refill();
+        const int ret = inflate(&m_Stream, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END && m_Stream.avail_out == 0) break;
+        if (ret != Z_OK)
+            throw std::runtime_error("corrupt png " + m_Path.u8string());
+    }
+
+    const size_t bpp = static_cast<size_t>(m_Channels) * m_BitDepth / 8;
+    const uint8_t filter = m_Row[0];
+    uint8_t* row = m_Row.data() + 1;
+    const uint8_t* prev = m_Prev.data();
+    for (size_t i = 0; i < m_RowBytes; ++i)
+    {
+        const int a = i >= bpp ? row[i - bpp] : 0;
+        const int b = prev[i];
+        const int c = i >= bpp ? prev[i - bpp] : 0;
+        switch (filter)
+        {
+        case 0: break;
+        case 1: row[i] = static_cast<uint8_t>(row[i] + a);
+            break;
+        case 2: row[i] = static_cast<uint8_t>(row[i] + b);
+            break;
+        case 3: row[i] = static_cast<uint8_t>(row[i] + ((a + b) >> 1));
+            break;
+        case 4: row[i] = static_cast<uint8_t>(row[i] + Paeth(a, b, c));
+            break;
+        default: throw std::runtime_error("corrupt png " + m_Path.u8string());
+        }
+    }
+
+    std::memcpy(m_Prev.data(), row, m_RowBytes);
+    ++m_Y;
+    return row;
+}
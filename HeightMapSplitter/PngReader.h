@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <zlib.h>
+
+// Reads a PNG a row at a time, top to bottom, inflating and unfiltering as it goes: the counterpart of
+// PngWriter for images that are not to be held whole. Only the current and the previous row are alive.
+// Non-interlaced gray, gray + alpha, rgb and rgba of 8 or 16 bits, the layouts heightmaps and masks come in.
+class PngReader
+{
+public:
+    // null when path is not a PNG of a layout read here, whoever asks loads it some other way
+    static std::unique_ptr<PngReader> Open(const std::filesystem::path& path);
+
+    ~PngReader();
+
+    PngReader(const PngReader&) = delete;
+    PngReader& operator=(const PngReader&) = delete;
+
+    [[nodiscard]] int Width() const { return m_Width; }
+    [[nodiscard]] int Height() const { return m_Height; }
+    [[nodiscard]] int Channels() const { return m_Channels; }
+    [[nodiscard]] int BitDepth() const { return m_BitDepth; }
+
+    // The next row of raw pixels, 16 bit samples big endian as PNG stores them. Valid until the next call.
+    const uint8_t* ReadRow();
+
+private:
+    explicit PngReader(const std::filesystem::path& path);
+
+    bool ReadHeader();
+    bool NextChunk(uint32_t& length, char type[4]);
+    void Refill();
+
+    std::ifstream m_File;
+    std::filesystem::path m_Path;
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_Channels = 0;
+    int m_BitDepth = 0;
+    size_t m_RowBytes = 0;
+
+    z_stream m_Stream {};
+    bool m_Inflating = false;
+    uint32_t m_ChunkLeft = 0;       // bytes of the current IDAT not read yet
+    std::vector<uint8_t> m_In;
+    std::vector<uint8_t> m_Row;     // filter byte, then the row
+    std::vector<uint8_t> m_Prev;    // the row above unfiltered, zeros above the first one
+    int m_Y = 0;
+};
@@ -0,0 +1,200 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <zlib.h>
+
+#include "Parallel.h"
+
+namespace
+{
+    void PutU32(uint8_t* p, const uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+
+    uint8_t Paeth(const int a, const int b, const int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+    // Filter one row with every PNG filter and keep the one with the smallest sum of signed residuals,
+    // the heuristic libpng and stb use.
+    void FilterRow(const uint8_t* row, const uint8_t* prev, const size_t n, const size_t bpp,
+        std::vector<uint8_t>& scratch, uint8_t* out)
+    {
+        scratch.resize(n);
+        unsigned best = ~0u;
+        for (int f = 0; f < 5; ++f)
+        {
+            unsigned cost = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                const int a = i >= bpp ? row[i - bpp] : 0;
+                const int b = prev ? prev[i] : 0;
+                const int c = i >= bpp && prev ? prev[i - bpp] : 0;
+                int pred = 0;
+                switch (f)
+                {
+                case 1: pred = a;
+                    break;
+                case 2: pred = b;
+                    break;
+                case 3: pred = (a + b) >> 1;
+                    break;
+                case 4: pred = Paeth(a, b, c);
+                    break;
+                default: break;
+                }
+                scratch[i] = static_cast<uint8_t>(row[i] - pred);
+                cost += std::abs(static_cast<int8_t>(scratch[i]));
+            }
+            if (cost < best)
+            {
+                best = cost;
+                out[0] = static_cast<uint8_t>(f);
+                std::memcpy(out + 1, scratch.data(), n);
+            }
+        }
+    }
+}
+
+PngWriter::PngWriter(
+    const std::filesystem::path& path, const int width, const int height, const int channels, const int bitDepth) :
+    m_File(path, std::ios::binary | std::ios::out), m_Path(path),
+    m_Width(width), m_Height(height), m_Channels(channels), m_BitDepth(bitDepth),
+    m_RowBytes(static_cast<size_t>(width) * channels * bitDepth / 8)
+{
+    if (!m_File)
+        throw std::runtime_error("failed to open " + path.u8string());
+    if (channels < 1 || channels > 4 || (bitDepth != 8 && bitDepth != 16))
+        throw std::runtime_error("unsupported png layout");
+
+    static constexpr uint8_t Signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    m_File.write(reinterpret_cast<const char*>(Signature), sizeof(Signature));
+
+    // gray, gray + alpha, rgb, rgba
+    static constexpr uint8_t ColorType[] = { 0, 4, 2, 6 };
+    uint8_t ihdr[13] {};
+    PutU32(ihdr, width);
+    PutU32(ihdr + 4, height);
+    ihdr[8] = static_cast<uint8_t>(bitDepth);
+    ihdr[9] = ColorType[channels - 1];
+    WriteChunk("IHDR", ihdr, sizeof(ihdr));
+}
+
+void PngWriter::Write(const RowSource& source, const int bandRows)
+{
+    const int bandCount = (m_Height + bandRows - 1) / bandRows;
+    const int window = std::max<int>(1, std::thread::hardware_concurrency() * 2);
+
+    // zlib header: deflate, 32K window, default level
+    static constexpr uint8_t ZlibHeader[] = { 0x78, 0x9c };
+    WriteChunk("IDAT", ZlibHeader, sizeof(ZlibHeader));
+
+    uint32_t adler = adler32(0, nullptr, 0);
+    std::vector<Band> bands(window);
+    for (int w0 = 0; w0 < bandCount; w0 += window)
+    {
+        const int w1 = std::min(w0 + window, bandCount);
+        ParallelFor(w0, w1, 1, [&](const int b0, const int b1)
+        {
+            for (int b = b0; b < b1; ++b)
+                EncodeBand(source, b * bandRows, std::min((b + 1) * bandRows, m_Height), bands[b - w0]);
+        });
+
+        // bands leave in order, each becomes one IDAT and is released right after
+        for (int b = w0; b < w1; ++b)
+        {
+            auto& band = bands[b - w0];
+            WriteChunk("IDAT", band.Deflated.data(), band.Deflated.size());
+            adler = adler32_combine(adler, band.Adler, static_cast<z_off_t>(band.RawSize));
+            std::vector<uint8_t>().swap(band.Deflated);
+        }
+    }
+
+    uint8_t trailer[4];
+    PutU32(trailer, adler);
+    WriteChunk("IDAT", trailer, sizeof(trailer));
+    WriteChunk("IEND", nullptr, 0);
+    m_File.close();
+    if (!m_File)
+        throw std::runtime_error("failed to write " + m_Path.u8string());
+}
+
+void PngWriter::Save(const std::filesystem::path& path, const uint8_t* data,
+    const int width, const int height, const int channels, const int bitDepth)
+{
+    const size_t rowBytes = static_cast<size_t>(width) * channels * bitDepth / 8;
+    PngWriter(path, width, height, channels, bitDepth).Write([&](const int y, uint8_t* row)
+    {
+        std::memcpy(row, data + y * rowBytes, rowBytes);
+    });
+}
+
+void PngWriter::EncodeBand(const RowSource& source, const int y0, const int y1, Band& band) const
+{
+    const size_t bpp = std::max(1, m_Channels * m_BitDepth / 8);
+
+    // the filters of the first row need the last row of the previous band
+    std::vector<uint8_t> prev(y0 > 0 ? m_RowBytes : 0);
+    std::vector<uint8_t> row(m_RowBytes);
+    if (y0 > 0) source(y0 - 1, prev.data());
+
+    std::vector<uint8_t> filtered((m_RowBytes + 1) * (y1 - y0));
+    std::vector<uint8_t> scratch;
+    for (int y = y0; y < y1; ++y)
+    {
+        source(y, row.data());
+        FilterRow(row.data(), prev.empty() ? nullptr : prev.data(), m_RowBytes, bpp, scratch,
+            filtered.data() + (y - y0) * (m_RowBytes + 1));
+        prev.swap(row);
+        row.resize(m_RowBytes);
+    }
+
+    z_stream zs {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("deflateInit2 failed");
+    band.Deflated.resize(deflateBound(&zs, static_cast<uLong>(filtered.size())) + 16);
+    zs.next_in = filtered.data();
+    zs.avail_in = static_cast<uInt>(filtered.size());
+    zs.next_out = band.Deflated.data();
+    zs.avail_out = static_cast<uInt>(band.Deflated.size());
+
+    // a full flush ends the band on a byte boundary with fresh state, the last band closes the stream
+    const int flush = y1 == m_Height ? Z_FINISH : Z_FULL_FLUSH;
+    const int ret = deflate(&zs, flush);
+    deflateEnd(&zs);
+    if (ret != (flush == Z_FINISH ? Z_STREAM_END : Z_OK) || zs.avail_in != 0)
+        throw std::runtime_error("deflate failed");
+
+    band.Deflated.resize(band.Deflated.size() - zs.avail_out);
+    band.Adler = adler32(adler32(0, nullptr, 0), filtered.data(), static_cast<uInt>(filtered.size()));
+    band.RawSize = filtered.size();
+}
+
+void PngWriter::WriteChunk(const char type[4], const uint8_t* data, const size_t size)
+{
+    uint8_t length[4];
+    PutU32(length, static_cast<uint32_t>(size));
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0) crc = crc32(crc, data, static_cast<uInt>(size));
+    uint8_t crcBytes[4];
+    PutU32(crcBytes, static_cast<uint32_t>(crc));
+
+    m_File.write(reinterpret_cast<const char*>(length), 4);
+    m_File.write(type, 4);
+    if (size > 0) m_File.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_File.write(reinterpret_cast<const char*>(crcBytes), 4);
+}
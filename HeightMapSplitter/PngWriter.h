@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+// Streams a PNG whose row bands are filtered and deflated in parallel.
+// Every band is an independent raw deflate run ending on a full flush, so the bands concatenate into
+// one valid zlib stream; their adler32 is combined in order. Only a window of bands is alive at a time,
+// neither the raw nor the encoded image is ever held whole.
+class PngWriter
+{
+public:
+    // fills one row of raw pixels, 16 bit samples big endian as PNG stores them
+    using RowSource = std::function<void(int y, uint8_t* row)>;
+
+    PngWriter(const std::filesystem::path& path, int width, int height, int channels, int bitDepth = 8);
+
+    void Write(const RowSource& source, int bandRows = 64);
+
+    // Convenience for an image already in memory, rows tightly packed.
+    static void Save(const std::filesystem::path& path, const uint8_t* data,
+        int width, int height, int channels, int bitDepth = 8);
+
+private:
+    struct Band
+    {
+        std::vector<uint8_t> Deflated;
+        uint32_t Adler;
+        size_t RawSize;
+    };
+
+    void EncodeBand(const RowSource& source, int y0, int y1, Band& band) const;
+    void WriteChunk(const char type[4], const uint8_t* data, size_t size);
+
+    std::ofstream m_File;
+    std::filesystem::path m_Path;
+    const int m_Width;
+    const int m_Height;
+    const int m_Channels;
+    const int m_BitDepth;
+    const size_t m_RowBytes;
+};
@@ -0,0 +1,218 @@
+#include "PointPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <xsimd/xsimd.hpp>
+
+#include "heightmap.h"
+#include "Parallel.h"
+
+using FloatBatch = xsimd::batch<float, xsimd::default_arch>;
+
+namespace
+{
+    constexpr size_t Stride = FloatBatch::size;
+}
+
+PointPipeline& PointPipeline::AutoLevel()
+{
+    m_Ops.push_back({ Op::Level, 0.0f, 0.0f });
+    return *this;
+}
+
+PointPipeline& PointPipeline::Invert()
+{
+    return Affine(-1.0f, 1.0f);
+}
+
+PointPipeline& PointPipeline::GammaCurve(const float gamma)
+{
+    m_Ops.push_back({ Op::Gamma, gamma, 0.0f });
+    return *this;
+}
+
+PointPipeline& PointPipeline::Affine(const float scale, const float bias)
+{
+    m_Ops.push_back({ Op::Scale, scale, bias });
+    return *this;
+}
+
+PointPipeline& PointPipeline::AddBorder(const int size, const float z)
+{
+    if (size > 0) m_Ops.push_back({ Op::Border, static_cast<float>(size), z });
+    return *this;
+}
+
+std::pair<float, float> PointPipeline::Range(const float* data, const size_t count)
+{
+    if (count == 0) return { 0.0f, 0.0f };
+
+    std::mutex mutex;
+    float lo = data[0];
+    float hi = data[0];
+    const int n = static_cast<int>((count + Stride - 1) / Stride);
+    ParallelFor(0, n, ParallelGrain(n), [&](const int b, const int e)
+    {
+        const size_t begin = b * Stride;
+        const size_t end = std::min(e * Stride, count);
+        FloatBatch bLo(data[begin]);
+        FloatBatch bHi(data[begin]);
+        size_t i = begin;
+        for (; i + Stride <= end; i += Stride)
+        {
+            const auto v = FloatBatch::load_unaligned(data + i);
+            bLo = xsimd::min(bLo, v);
+            bHi = xsimd::max(bHi, v);
+        }
+        float l = xsimd::reduce_min(bLo);
+        float h = xsimd::reduce_max(bHi);
+        for (; i < end; ++i)
+        {
+            l = std::min(l, data[i]);
+            h = std::max(h, data[i]);
+        }
+        std::lock_guard lock(mutex);
+        lo = std::min(lo, l);
+        hi = std::max(hi, h);
+    });
+    return { lo, hi };
+}
+
+std::vector<PointPipeline::Op> PointPipeline::Resolve(std::vector<Op>& rings) const
+{
+    const bool needRange = std::any_of(m_Ops.begin(), m_Ops.end(),
+        [](const Op& op) { return op.Type == Op::Level; });
+
+    float lo = 0.0f, hi = 0.0f;
+    if (needRange)
+        std::tie(lo, hi) = Range(m_Target.m_Data.data(), m_Target.m_Data.size());
+
+    std::vector<Op> resolved;
+    rings.clear();
+    for (auto op : m_Ops)
+    {
+        if (op.Type == Op::Border)
+        {
+            // a ring only sees the ops queued after it, and the levels after it see the ring
+            rings.insert(rings.begin(), op);
+            lo = std::min(lo, op.B);
+            hi = std::max(hi, op.B);
+            continue;
+        }
+
+        if (op.Type == Op::Level)
+        {
+            // same early out as the scalar version when the map is flat
+            if (hi == lo) continue;
+            op = { Op::Scale, 1.0f / (hi - lo), -lo / (hi - lo) };
+        }
+
+        // track the range through the op, every op is monotonic
+        const auto eval = [&op](const float x)
+        {
+            return op.Type == Op::Scale ? x * op.A + op.B : std::pow(x, op.A);
+        };
+        lo = eval(lo);
+        hi = eval(hi);
+        if (lo > hi) std::swap(lo, hi);
+        for (auto& ring : rings)
+            ring.B = eval(ring.B);
+
+        // fold consecutive affine ops into one
+        if (op.Type == Op::Scale && !resolved.empty() && resolved.back().Type == Op::Scale)
+        {
+            auto& prev = resolved.back();
+            prev.B = prev.B * op.A + op.B;
+            prev.A = prev.A * op.A;
+            continue;
+        }
+        resolved.push_back(op);
+    }
+    return resolved;
+}
+
+void PointPipeline::Run()
+{
+    std::vector<Op> rings;
+    const auto ops = Resolve(rings);
+    auto& src = m_Target.m_Data;
+    const int w = m_Target.m_Width;
+    const int h = m_Target.m_Height;
+    int b = 0;
+    for (const auto& ring : rings)
+        b += static_cast<int>(ring.A);
+    const int dw = w + b * 2;
+    const int dh = h + b * 2;
+    if (ops.empty() && b == 0) return;
+    m_Target.m_Pyramid.reset();
+
+    auto apply = [&ops](auto x)
+    {
+        for (const auto& op : ops)
+        {
+            if (op.Type == Op::Scale)
+                x = x * op.A + op.B;
+            else if constexpr (std::is_same_v<decltype(x), float>)
+                x = std::pow(x, op.A);
+            else
+                x = xsimd::pow(x, FloatBatch(op.A));
+        }
+        return x;
+    };
+
+    // transform in place when the layout stays, otherwise write straight into the bordered image
+    std::vector<float> bordered;
+    if (b > 0) bordered.resize(static_cast<size_t>(dw) * dh);
+    float* dst = b > 0 ? bordered.data() : src.data();
+
+    // value of the ring a bordered pixel falls in, rings are ordered outermost first
+    auto ringValue = [&rings](const int depth)
+    {
+        int edge = 0;
+        for (const auto& ring : rings)
+        {
+            edge += static_cast<int>(ring.A);
+            if (depth < edge) return ring.B;
+        }
+        return rings.back().B;
+    };
+
+    ParallelFor(0, dh, ParallelGrain(dh), [&](const int y0, const int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            float* row = dst + static_cast<size_t>(y) * dw;
+            const int sy = y - b;
+            const int dy = std::min(y, dh - 1 - y);
+            if (sy < 0 || sy >= h)
+            {
+                for (int x = 0; x < dw; ++x)
+                    row[x] = ringValue(std::min(dy, std::min(x, dw - 1 - x)));
+                continue;
+            }
+            for (int x = 0; x < b; ++x)
+            {
+                row[x] = ringValue(std::min(dy, x));
+                row[dw - 1 - x] = row[x];
+            }
+
+            const float* in = src.data() + static_cast<size_t>(sy) * w;
+            float* out = row + b;
+            int x = 0;
+            for (; x + static_cast<int>(Stride) <= w; x += Stride)
+                apply(FloatBatch::load_unaligned(in + x)).store_unaligned(out + x);
+            for (; x < w; ++x)
+                out[x] = apply(in[x]);
+        }
+    });
+
+    if (b > 0)
+    {
+        m_Target.m_Width = dw;
+        m_Target.m_Height = dh;
+        src = std::move(bordered);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class Heightmap;
+
+// Chains point operations over a heightmap and runs them fused.
+// Every op is monotonic, so the range an AutoLevel needs is propagated analytically from one
+// min/max reduction over the source instead of being measured again after each op.
+// Run() costs at most one read-only reduction pass plus one transform pass.
+// AddBorder never copies the image: the transform pass writes into the bordered layout directly
+// and fills the rings, whose values still go through the ops queued after them.
+class PointPipeline
+{
+public:
+    explicit PointPipeline(Heightmap& target) : m_Target(target) {}
+
+    PointPipeline& AutoLevel();
+    PointPipeline& Invert();
+    PointPipeline& GammaCurve(float gamma);
+    PointPipeline& Affine(float scale, float bias);
+    PointPipeline& AddBorder(int size, float z);
+
+    void Run();
+
+    // Parallel SIMD min / max over raw samples.
+    static std::pair<float, float> Range(const float* data, size_t count);
+
+private:
+    struct Op
+    {
+        enum Kind
+        {
+            Scale,      // x * A + B
+            Gamma,      // pow(x, A)
+            Level,      // resolved into Scale once the incoming range is known
+            Border,     // ring of A pixels set to B, later ops still apply to B
+        };
+
+        Kind Type;
+        float A;
+        float B;
+    };
+
+    std::vector<Op> Resolve(std::vector<Op>& rings) const;
+
+    Heightmap& m_Target;
+    std::vector<Op> m_Ops {};
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+
+// A sharded build splits the patch rows into Count contiguous bands and shard Index cuts and saves band
+// Index, triangulating the row on either side as well for the seams. Shards only meet through files in
+// the shared output directory: each one leaves shards/shard_<Index>.json once its patches are on disk,
+// and the merge step refuses to run until every band is there and all of them agree on the build.
+struct ShardPlan
+{
+    int Index = 0;
+    int Count = 0;  // 0 when the build is not sharded
+
+    [[nodiscard]] int RowBegin(const int ny) const
+    {
+        return Count ? static_cast<int>(static_cast<int64_t>(ny) * Index / Count) : 0;
+    }
+
+    [[nodiscard]] int RowEnd(const int ny) const
+    {
+        return Count ? static_cast<int>(static_cast<int64_t>(ny) * (Index + 1) / Count) : ny;
+    }
+
+    [[nodiscard]] static std::filesystem::path ManifestPath(const std::filesystem::path& dir, const int index)
+    {
+        return dir / "shards" / ("shard_" + std::to_string(index) + ".json");
+    }
+
+    // written under a temporary name and renamed, a manifest that exists is complete
+    void SaveManifest(const std::filesystem::path& dir, const int nx, const int ny, const int lodCount,
+        const uint64_t key) const
+    {
+        nlohmann::json j;
+        j["shard"] = Index;
+        j["shards"] = Count;
+        j["nx"] = nx;
+        j["ny"] = ny;
+        j["lods"] = lodCount;
+        j["key"] = key;
+        j["rows"] = { RowBegin(ny), RowEnd(ny) };
+
+        const auto path = ManifestPath(dir, Index);
+        create_directories(path.parent_path());
+        auto staging = path;
+        staging += ".tmp";
+        {
+            std::ofstream ofs(staging);
+            ofs << std::setw(4) << j;
+            if (!ofs)
+                throw std::runtime_error("failed to write " + staging.u8string());
+        }
+        std::filesystem::rename(staging, path);
+        std::printf("%s generated\n", path.u8string().c_str());
+    }
+
+    // Throws unless count manifests cover every row exactly once with the same grid and LODs, and each one's
+    // key is key(rows) for the rows it covers. The key hashes the build settings and the pixels of those rows,
+    // so shards of another heightmap are never mixed in.
+    static void CheckManifests(const std::filesystem::path& dir, const int count, const int nx, const int ny,
+        const int lodCount, const std::function<uint64_t(int rowBegin, int rowEnd)>& key)
+    {
+        int next = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const auto path = ManifestPath(dir, i);
+            std::ifstream ifs(path);
+            if (!ifs)
+                throw std::runtime_error("shard " + std::to_string(i) + " has not finished, " + path.u8string() +
+                    " is missing");
+            nlohmann::json j;
+            ifs >> j;
+            if (j["shards"].get<int>() != count || j["nx"].get<int>() != nx || j["ny"].get<int>() != ny ||
+                j["lods"].get<int>() != lodCount)
+                throw std::runtime_error(path.u8string() + " was built with other settings");
+            const int rowBegin = j["rows"][0].get<int>();
+            const int rowEnd = j["rows"][1].get<int>();
+            if (rowBegin != next || rowEnd < rowBegin || rowEnd > ny)
+                throw std::runtime_error(path.u8string() + " does not continue at row " + std::to_string(next));
+            if (j["key"].get<uint64_t>() != key(rowBegin, rowEnd))
+                throw std::runtime_error(path.u8string() + " was built from other pixels or settings");
+            next = rowEnd;
+        }
+        if (next != ny)
+            throw std::runtime_error("shards cover " + std::to_string(next) + " of " + std::to_string(ny) + " rows");
+    }
+};
@@ -1,16 +1,78 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <iterator>
+#include <limits>
 
 #include "triangulator.h"
 
+// One bit per boundary pixel on each of the 4 sides of a patch. Built from a patch's own border
+// vertices, then OR-ed with the facing side of each neighbour, it answers the rivet query with a
+// shift and a mask instead of a hash lookup.
+struct EdgeMask
+{
+    enum Side { Left, Right, Top, Bottom, SideCount };  // x = 0, x = 255, y = 0, y = 255
+
+    static constexpr int Size = 256;
+    static constexpr int Words = Size / 64;
+
+    uint64_t Bits[SideCount][Words] {};
+
+    static EdgeMask FromVertices(const std::vector<Triangulator::PackedPoint>& vertices)
+    {
+        EdgeMask mask;
+        for (const auto& v : vertices)
+        {
+            if (v.PosX == 0) mask.Set(Left, v.PosY);
+            if (v.PosX == Size - 1) mask.Set(Right, v.PosY);
+            if (v.PosY == 0) mask.Set(Top, v.PosX);
+            if (v.PosY == Size - 1) mask.Set(Bottom, v.PosX);
+        }
+        return mask;
+    }
+
+    // adds the vertices the neighbour on side has along the shared edge
+    void Merge(const Side side, const EdgeMask& neighbour)
+    {
+        static constexpr Side Facing[SideCount] = { Right, Left, Bottom, Top };
+        for (int i = 0; i < Words; ++i)
+            Bits[side][i] |= neighbour.Bits[Facing[side]][i];
+    }
+
+    EdgeMask& operator|=(const EdgeMask& other)
+    {
+        for (int s = 0; s < SideCount; ++s)
+            for (int i = 0; i < Words; ++i)
+                Bits[s][i] |= other.Bits[s][i];
+        return *this;
+    }
+
+    void Set(const Side side, const int i)
+    {
+        Bits[side][i >> 6] |= uint64_t(1) << (i & 63);
+    }
+
+    [[nodiscard]] bool Get(const Side side, const int i) const
+    {
+        return (Bits[side][i >> 6] >> (i & 63)) & 1;
+    }
+
+    [[nodiscard]] bool Contains(const Triangulator::PackedPoint p) const
+    {
+        return (p.PosX == 0 && Get(Left, p.PosY)) || (p.PosX == Size - 1 && Get(Right, p.PosY)) ||
+            (p.PosY == 0 && Get(Top, p.PosX)) || (p.PosY == Size - 1 && Get(Bottom, p.PosX));
+    }
+};
+
 struct SideCutter
 {
 public:
-    static void Cut(
-        Triangulator::PackedMesh& mesh, const unsigned int gridSize,
-        const std::function<bool(Triangulator::PackedPoint)>& shouldAdd)
+    // shouldAdd(PackedPoint) -> bool is called for every boundary pixel a split may insert,
+    // taken as a template so it inlines into the loops
+    template <typename Predicate>
+    static void Cut(Triangulator::PackedMesh& mesh, const unsigned int gridSize, const Predicate& shouldAdd)
     {
         auto& [points, triangles] = mesh;
         std::deque<uint32_t> exteriorTriangles;
@@ -143,7 +205,102 @@ public:
         std::copy(exteriorTriangles.begin(), exteriorTriangles.end(), std::back_inserter(triangles));
     }
 
+    // Strip closing the T-junctions along side between the mesh's border and a coarser neighbour whose
+    // border only has the vertices in coarse. Every run of fine vertices between two shared ones and the
+    // coarse edge across it bound a hole in the upright plane of the seam, height(PackedPoint) -> float
+    // places the vertices in it. The hole is triangulated in both windings.
+    template <typename Height>
+    static std::vector<uint32_t> Stitch(const std::vector<Triangulator::PackedPoint>& points,
+        const EdgeMask::Side side, const EdgeMask& coarse, const Height& height)
+    {
+        constexpr int last = EdgeMask::Size - 1;
+        int onSide[EdgeMask::Size];
+        std::fill(std::begin(onSide), std::end(onSide), -1);
+        for (uint32_t i = 0; i < points.size(); ++i)
+        {
+            const auto p = points[i];
+            if (side == EdgeMask::Left && p.PosX == 0) onSide[p.PosY] = static_cast<int>(i);
+            if (side == EdgeMask::Right && p.PosX == last) onSide[p.PosY] = static_cast<int>(i);
+            if (side == EdgeMask::Top && p.PosY == 0) onSide[p.PosX] = static_cast<int>(i);
+            if (side == EdgeMask::Bottom && p.PosY == last) onSide[p.PosX] = static_cast<int>(i);
+        }
+
+        // the run since the last vertex both borders have, along the side and up
+        std::vector<uint32_t> strip;
+        std::vector<uint32_t> run;
+        std::vector<glm::vec2> plane;
+        for (int k = 0; k <= last; ++k)
+        {
+            const int v = onSide[k];
+            if (v < 0) continue;
+            // the ends of a side are corners every LOD keeps
+            const bool isShared = k == 0 || k == last || coarse.Get(side, k);
+            if (run.empty() && !isShared) continue;
+            run.push_back(static_cast<uint32_t>(v));
+            plane.emplace_back(static_cast<float>(k), height(points[v]));
+            if (!isShared || run.size() == 1) continue;
+            CloseHole(run, plane, strip);
+            run.erase(run.begin(), run.end() - 1);
+            plane.erase(plane.begin(), plane.end() - 1);
+        }
+        return strip;
+    }
+
 private:
+    static float Cross(const glm::vec2 a, const glm::vec2 b)
+    {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    // Triangulates the hole between a run of the fine border and the straight coarse edge from its first to
+    // its last vertex. Every triangulation of the polygon the two close covers the hole, also where the
+    // border crosses the edge and the hole falls apart into pieces that meet where no vertex is. Of those,
+    // the one of least total area overlaps least: without a crossing it is the hole exactly, with one it
+    // only spills over near the crossings. A fan from one end instead folds over itself where the border
+    // dips and stands up above both surfaces. Runs are short, the O(n^3) search over splits is cheap.
+    static void CloseHole(const std::vector<uint32_t>& run, const std::vector<glm::vec2>& plane,
+        std::vector<uint32_t>& strip)
+    {
+        const size_t n = run.size();
+        if (n < 3) return;
+        // area[i * n + j] is the least area of the polygon i..j closed by the edge from j back to i,
+        // apex[i * n + j] the vertex its triangle on that edge takes
+        std::vector<float> area(n * n, 0.0f);
+        std::vector<uint32_t> apex(n * n, 0);
+        for (size_t length = 2; length < n; ++length)
+        {
+            for (size_t i = 0; i + length < n; ++i)
+            {
+                const size_t j = i + length;
+                float best = std::numeric_limits<float>::max();
+                for (size_t k = i + 1; k < j; ++k)
+                {
+                    const float a = area[i * n + k] + area[k * n + j] +
+                        std::abs(Cross(plane[k] - plane[i], plane[j] - plane[i]));
+                    if (a < best)
+                    {
+                        best = a;
+                        apex[i * n + j] = static_cast<uint32_t>(k);
+                    }
+                }
+                area[i * n + j] = best;
+            }
+        }
+
+        std::vector<std::pair<size_t, size_t>> edges { { 0, n - 1 } };
+        while (!edges.empty())
+        {
+            const auto [i, j] = edges.back();
+            edges.pop_back();
+            if (j - i < 2) continue;
+            const size_t k = apex[i * n + j];
+            AddTriangle(strip, run[i], run[k], run[j]);
+            AddTriangle(strip, run[i], run[j], run[k]);
+            edges.emplace_back(i, k);
+            edges.emplace_back(k, j);
+        }
+    }
+
     static bool CanSplit(
         const Triangulator::PackedPoint p0, const Triangulator::PackedPoint p1, const unsigned int gridSize)
     {
@@ -0,0 +1,200 @@
+#include "SourceTiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <DirectXTex.h>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+
+#include "heightmap.h"
+#include "Parallel.h"
+
+namespace
+{
+    int MipCount(const int w, const int h)
+    {
+        int n = 1;
+        while ((w >> n) > 0 || (h >> n) > 0) ++n;
+        return n;
+    }
+
+    uint32_t PackUnorm(const glm::vec4& v)
+    {
+        const glm::vec4 c = glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return static_cast<uint32_t>(c.x) | static_cast<uint32_t>(c.y) << 8 |
+            static_cast<uint32_t>(c.z) << 16 | static_cast<uint32_t>(c.w) << 24;
+    }
+
+    glm::vec4 UnpackUnorm(const uint32_t c)
+    {
+        return glm::vec4(c & 0xff, c >> 8 & 0xff, c >> 16 & 0xff, c >> 24) * (1.0f / 255.0f);
+    }
+
+    // Writes the DDS header, then fills mip 0 and reduces every next level from the previous one.
+    // fill(y, row) writes mip 0 row y, reduce(a, b, c, d) merges a 2 x 2 footprint.
+    template <class T, class Fill, class Reduce>
+    void WriteMipChain(const std::filesystem::path& path, const DXGI_FORMAT format,
+        const int w, const int h, Fill&& fill, Reduce&& reduce)
+    {
+        DirectX::TexMetadata meta {};
+        meta.width = w;
+        meta.height = h;
+        meta.depth = 1;
+        meta.arraySize = 1;
+        meta.mipLevels = MipCount(w, h);
+        meta.format = format;
+        meta.dimension = DirectX::TEX_DIMENSION_TEXTURE2D;
+
+        size_t required = 0;
+        if (FAILED(EncodeDDSHeader(meta, DirectX::DDS_FLAGS_NONE, nullptr, 0, required)))
+            throw std::runtime_error("failed to encode dds header");
+        std::vector<uint8_t> header(required);
+        if (FAILED(EncodeDDSHeader(meta, DirectX::DDS_FLAGS_NONE, header.data(), header.size(), required)))
+            throw std::runtime_error("failed to encode dds header");
+
+        std::ofstream ofs(path, std::ios::binary | std::ios::out);
+        if (!ofs)
+            throw std::runtime_error("failed to open " + path.u8string());
+        ofs.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(required));
+
+        std::vector<T> level(static_cast<size_t>(w) * h);
+        ParallelFor(0, h, ParallelGrain(h), [&](const int y0, const int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+                fill(y, level.data() + static_cast<size_t>(y) * w);
+        });
+        ofs.write(reinterpret_cast<const char*>(level.data()), static_cast<std::streamsize>(level.size() * sizeof(T)));
+
+        int lw = w;
+        int lh = h;
+        std::vector<T> next;
+        for (size_t m = 1; m < meta.mipLevels; ++m)
+        {
+            const int nw = std::max(1, lw >> 1);
+            const int nh = std::max(1, lh >> 1);
+            next.resize(static_cast<size_t>(nw) * nh);
+            ParallelFor(0, nh, ParallelGrain(nh), [&](const int y0, const int y1)
+            {
+                for (int y = y0; y < y1; ++y)
+                {
+                    // odd sizes clamp the footprint to the last texel
+                    const T* r0 = level.data() + static_cast<size_t>(std::min(y * 2, lh - 1)) * lw;
+                    const T* r1 = level.data() + static_cast<size_t>(std::min(y * 2 + 1, lh - 1)) * lw;
+                    for (int x = 0; x < nw; ++x)
+                    {
+                        const int x0 = std::min(x * 2, lw - 1);
+                        const int x1 = std::min(x * 2 + 1, lw - 1);
+                        next[static_cast<size_t>(y) * nw + x] = reduce(r0[x0], r0[x1], r1[x0], r1[x1]);
+                    }
+                }
+            });
+            ofs.write(reinterpret_cast<const char*>(next.data()), static_cast<std::streamsize>(next.size() * sizeof(T)));
+            level.swap(next);
+            lw = nw;
+            lh = nh;
+        }
+
+        if (!ofs)
+            throw std::runtime_error("failed to write " + path.u8string());
+        std::printf("%s generated\n", path.u8string().c_str());
+    }
+}
+
+SourceTiler::SourceTiler(const Heightmap& heightmap, const float zScale, const int tilesX, const int tilesY) :
+    m_Heightmap(heightmap), m_ZScale(zScale), m_Layout(heightmap.Width(), heightmap.Height(), tilesX, tilesY)
+{
+}
+
+uint32_t SourceTiler::Normal(const int x, const int y) const
+{
+    const int w = m_Heightmap.Width();
+    const int h = m_Heightmap.Height();
+    const int x0 = std::max(x - 1, 0);
+    const int x1 = std::min(x + 1, w - 1);
+    const int y0 = std::max(y - 1, 0);
+    const int y1 = std::min(y + 1, h - 1);
+
+    // y up, world z runs along the pixel rows, stored as (x, z, y) the way GridPS reads it back
+    const float dx = (m_Heightmap.At(x1, y) - m_Heightmap.At(x0, y)) * m_ZScale / static_cast<float>(x1 - x0);
+    const float dz = (m_Heightmap.At(x, y1) - m_Heightmap.At(x, y0)) * m_ZScale / static_cast<float>(y1 - y0);
+    const glm::vec3 n = glm::normalize(glm::vec3(-dx, 1.0f, -dz)) * 0.5f + 0.5f;
+    const float ao = m_Ao ? (*m_Ao)[static_cast<size_t>(y) * w + x] : 1.0f;
+    return PackUnorm(glm::vec4(n.x, n.z, n.y, ao));
+}
+
+void SourceTiler::Run(const std::filesystem::path& dir, const unsigned layers) const
+{
+    const int tw = m_Layout.TileWidth;
+    const int th = m_Layout.TileHeight;
+
+    const auto boxHeight = [](const uint16_t a, const uint16_t b, const uint16_t c, const uint16_t d)
+    {
+        return static_cast<uint16_t>((static_cast<uint32_t>(a) + b + c + d + 2) >> 2);
+    };
+    const auto boxColor = [](const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t d)
+    {
+        return PackUnorm((UnpackUnorm(a) + UnpackUnorm(b) + UnpackUnorm(c) + UnpackUnorm(d)) * 0.25f);
+    };
+    const auto renormalize = [](const uint32_t a, const uint32_t b, const uint32_t c, const uint32_t d)
+    {
+        const glm::vec4 sum = UnpackUnorm(a) + UnpackUnorm(b) + UnpackUnorm(c) + UnpackUnorm(d);
+        const glm::vec3 n = glm::normalize(glm::vec3(sum) * 0.5f - 1.0f) * 0.5f + 0.5f;
+        return PackUnorm(glm::vec4(n, sum.w * 0.25f));
+    };
+
+    for (int ty = 0; ty < m_Layout.TilesY; ++ty)
+    {
+        for (int tx = 0; tx < m_Layout.TilesX; ++tx)
+        {
+            const int ox = m_Layout.OriginX(tx);
+            const int oy = m_Layout.OriginY(ty);
+            const auto id = std::to_string(m_Layout.Index(tx, ty));
+
+            if (layers & HeightLayer)
+                WriteMipChain<uint16_t>(dir / ("height" + id + ".dds"), DXGI_FORMAT_R16_UNORM, tw, th,
+                    [this, ox, oy, tw](const int y, uint16_t* row)
+                    {
+                        for (int x = 0; x < tw; ++x)
+                        {
+                            const float v = std::clamp(m_Heightmap.At(ox + x, oy + y), 0.0f, 1.0f);
+                            row[x] = static_cast<uint16_t>(v * 65535.0f + 0.5f);
+                        }
+                    }, boxHeight);
+
+            if (layers & NormalLayer)
+                WriteMipChain<uint32_t>(dir / ("normal" + id + ".dds"), DXGI_FORMAT_R8G8B8A8_UNORM, tw, th,
+                    [this, ox, oy, tw](const int y, uint32_t* row)
+                    {
+                        for (int x = 0; x < tw; ++x)
+                            row[x] = Normal(ox + x, oy + y);
+                    }, renormalize);
+
+            // without weights to write the splat tiles already there, painted or baked before, stay as they are
+            if ((layers & SplatLayer) && m_Splat)
+                WriteMipChain<uint32_t>(dir / ("splat" + id + ".dds"), DXGI_FORMAT_R8G8B8A8_UNORM, tw, th,
+                    [this, ox, oy, tw](const int y, uint32_t* row)
+                    {
+                        m_Splat(ox, oy + y, tw, row);
+                    }, boxColor);
+        }
+    }
+
+    if (!(layers & HeightLayer)) return;
+
+    // the viewer repeats the tiles, so its culling pyramid covers exactly the tiled area
+    HeightPyramid(m_Layout.Width(), m_Layout.Height(),
+        [this](const int x, const int y) { return m_Heightmap.At(x, y); }).Save(dir / "tiles.pyramid");
+    std::printf("%s generated\n", (dir / "tiles.pyramid").u8string().c_str());
+
+    nlohmann::json j;
+    j["tilesX"] = m_Layout.TilesX;
+    j["tilesY"] = m_Layout.TilesY;
+    j["tileWidth"] = tw;
+    j["tileHeight"] = th;
+    j["mips"] = MipCount(tw, th);
+    std::ofstream ofs(dir / "tiles.json");
+    ofs << std::setw(4) << j;
+    std::printf("%s generated\n", (dir / "tiles.json").u8string().c_str());
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+#include "TileLayout.h"
+
+class Heightmap;
+
+// Cuts the world heightmap into the tilesX x tilesY source tiles the viewer streams from:
+// height<i>.dds (R16), normal<i>.dds (RGBA8, xzy normal + AO) and splat<i>.dds (RGBA8 layer weights),
+// i = ty * tilesX + tx, each with a full mip chain, plus tiles.json describing the grid and
+// tiles.pyramid for culling.
+// Mips are reduced in parallel and written one level at a time right after the DDS header,
+// so a tile never holds more than two levels.
+class SourceTiler
+{
+public:
+    // packed layer weights of heightmap pixels [x, x + count) of row y
+    using SplatSource = std::function<void(int x, int y, int count, uint32_t* out)>;
+
+    enum Layer : unsigned
+    {
+        HeightLayer = 1 << 0,    // also writes tiles.json and tiles.pyramid
+        NormalLayer = 1 << 1,
+        SplatLayer = 1 << 2,
+        AllLayers = HeightLayer | NormalLayer | SplatLayer,
+    };
+
+    SourceTiler(const Heightmap& heightmap, float zScale, int tilesX, int tilesY);
+
+    // optional occlusion stored in the normal alpha, one value per heightmap pixel
+    void SetAo(const std::vector<float>* ao) { m_Ao = ao; }
+
+    // layer weights per heightmap pixel, the splat layer is only written with a source set
+    void SetSplat(SplatSource splat) { m_Splat = std::move(splat); }
+
+    // writes the selected layers of every tile
+    void Run(const std::filesystem::path& dir, unsigned layers = AllLayers) const;
+
+private:
+    [[nodiscard]] uint32_t Normal(int x, int y) const;
+
+    const Heightmap& m_Heightmap;
+    const float m_ZScale;
+    const TileLayout m_Layout;
+    const std::vector<float>* m_Ao = nullptr;
+    SplatSource m_Splat = nullptr;
+};
@@ -0,0 +1,252 @@
+#include "SplatBaker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <xsimd/xsimd.hpp>
+
+#include "heightmap.h"
+
+using FloatBatch = xsimd::batch<float, xsimd::default_arch>;
+using IntBatch = xsimd::batch<int32_t, xsimd::default_arch>;
+using UintBatch = xsimd::batch<uint32_t, xsimd::default_arch>;
+
+namespace
+{
+    constexpr int Stride = static_cast<int>(FloatBatch::size);
+
+    FloatBatch Lanes()
+    {
+        alignas(64) float lanes[Stride];
+        for (int i = 0; i < Stride; ++i) lanes[i] = static_cast<float>(i);
+        return FloatBatch::load_aligned(lanes);
+    }
+
+    FloatBatch Band(const FloatBatch& v, const float lo, const float hi, const float invFade)
+    {
+        const FloatBatch zero(0.0f);
+        const FloatBatch one(1.0f);
+        return xsimd::clip((v - lo) * invFade + one, zero, one) * xsimd::clip((hi - v) * invFade + one, zero, one);
+    }
+
+    // lattice value in [0, 1), a murmur style finalizer over the cell coordinates
+    FloatBatch Hash(const IntBatch& x, const int y, const uint32_t seed)
+    {
+        UintBatch h = xsimd::bitwise_cast<uint32_t>(x) * UintBatch(0x8da6b343u) ^
+            UintBatch(static_cast<uint32_t>(y) * 0xd8163841u ^ seed);
+        h = (h ^ h >> 13) * UintBatch(0x85ebca6bu);
+        h = h ^ h >> 16;
+        return xsimd::batch_cast<float>(xsimd::bitwise_cast<int32_t>(h >> 8)) * (1.0f / 16777216.0f);
+    }
+
+    // smooth value noise in [0, 1)
+    FloatBatch ValueNoise(const FloatBatch& px, const float py, const uint32_t seed)
+    {
+        const FloatBatch fx = xsimd::floor(px);
+        const float fy = std::floor(py);
+        const IntBatch ix = xsimd::batch_cast<int32_t>(fx);
+        const int iy = static_cast<int>(fy);
+
+        const FloatBatch tx = px - fx;
+        const float ty = py - fy;
+        const FloatBatch sx = tx * tx * (3.0f - 2.0f * tx);
+        const float sy = ty * ty * (3.0f - 2.0f * ty);
+
+        const FloatBatch n0 = Hash(ix, iy, seed);
+        const FloatBatch n1 = Hash(ix + 1, iy, seed);
+        const FloatBatch n2 = Hash(ix, iy + 1, seed);
+        const FloatBatch n3 = Hash(ix + 1, iy + 1, seed);
+        const FloatBatch a = n0 + (n1 - n0) * sx;
+        const FloatBatch b = n2 + (n3 - n2) * sx;
+        return a + (b - a) * sy;
+    }
+
+    SplatRule::Band ParseBand(const nlohmann::json& j, const char* key)
+    {
+        SplatRule::Band band;
+        if (!j.contains(key)) return band;
+        const auto& b = j[key];
+        band.Min = b.value("min", band.Min);
+        band.Max = b.value("max", band.Max);
+        band.Fade = b.value("fade", band.Fade);
+        return band;
+    }
+}
+
+SplatBaker::SplatBaker(const Heightmap& heightmap, const float zScale, std::vector<SplatRule> rules) :
+    m_Heightmap(heightmap), m_ZScale(zScale)
+{
+    if (rules.empty() || rules.size() > LayerCount)
+        throw std::runtime_error("splat rules need 1 to 4 layers");
+
+    for (const auto& rule : rules)
+    {
+        Layer layer {};
+        layer.Weight = rule.Weight;
+        const SplatRule::Band* bands[] = { &rule.Altitude, &rule.Slope, &rule.Curvature };
+        for (int i = 0; i < 3; ++i)
+        {
+            layer.Min[i] = bands[i]->Min;
+            layer.Max[i] = bands[i]->Max;
+            layer.InvFade[i] = 1.0f / std::max(bands[i]->Fade, 1e-6f);
+        }
+        layer.Frequency = 1.0f / std::max(rule.NoiseScale, 1.0f);
+        layer.NoiseAmount = rule.NoiseAmount;
+        layer.Seed = rule.Seed;
+        m_Layers.push_back(layer);
+    }
+}
+
+std::vector<SplatRule> SplatBaker::DefaultRules()
+{
+    std::vector<SplatRule> rules(LayerCount);
+
+    rules[0].Name = "grass";
+    rules[0].Altitude = { -1e30f, 0.7f, 0.05f };
+    rules[0].Slope = { -1e30f, 0.6f, 0.15f };
+    rules[0].NoiseScale = 48.0f;
+    rules[0].NoiseAmount = 0.3f;
+    rules[0].Seed = 1;
+
+    rules[1].Name = "dirt";
+    rules[1].Slope = { -1e30f, 0.8f, 0.2f };
+    rules[1].Curvature = { 0.5f, 1e30f, 0.5f };
+    rules[1].NoiseScale = 24.0f;
+    rules[1].NoiseAmount = 0.5f;
+    rules[1].Seed = 2;
+
+    rules[2].Name = "rock";
+    rules[2].Slope = { 0.7f, 1e30f, 0.2f };
+
+    rules[3].Name = "snow";
+    rules[3].Altitude = { 0.75f, 1e30f, 0.05f };
+    rules[3].Slope = { -1e30f, 1.0f, 0.3f };
+    rules[3].NoiseScale = 32.0f;
+    rules[3].NoiseAmount = 0.2f;
+    rules[3].Seed = 3;
+
+    return rules;
+}
+
+std::vector<SplatRule> SplatBaker::LoadRules(const std::filesystem::path& path)
+{
+    std::ifstream ifs(path);
+    if (!ifs)
+        throw std::runtime_error("failed to open " + path.u8string());
+    const auto j = nlohmann::json::parse(ifs);
+
+    std::vector<SplatRule> rules;
+    for (const auto& l : j.at("layers"))
+    {
+        SplatRule rule;
+        rule.Name = l.value("name", "");
+        rule.Weight = l.value("weight", rule.Weight);
+        rule.Altitude = ParseBand(l, "altitude");
+        rule.Slope = ParseBand(l, "slope");
+        rule.Curvature = ParseBand(l, "curvature");
+        if (l.contains("noise"))
+        {
+            const auto& n = l["noise"];
+            rule.NoiseScale = n.value("scale", rule.NoiseScale);
+            rule.NoiseAmount = n.value("amount", rule.NoiseAmount);
+            rule.Seed = n.value("seed", rule.Seed);
+        }
+        rules.push_back(std::move(rule));
+    }
+    return rules;
+}
+
+void SplatBaker::EvaluateRow(const int x, const int y, const int count, uint32_t* out) const
+{
+    const int w = m_Heightmap.Width();
+    const int h = m_Heightmap.Height();
+    const int padded = (count + Stride - 1) / Stride * Stride;
+
+    // rows y - 1, y, y + 1 from x - 1, edges clamped, so the kernel only does unaligned loads
+    const int span = padded + 2;
+    std::vector<float> rows(static_cast<size_t>(span) * 3);
+    const int sourceRows[] = { std::max(y - 1, 0), y, std::min(y + 1, h - 1) };
+    for (int r = 0; r < 3; ++r)
+    {
+        const float* src = m_Heightmap.m_Data.data() + static_cast<size_t>(sourceRows[r]) * w;
+        float* dst = rows.data() + static_cast<size_t>(r) * span;
+        const int first = std::max(x - 1, 0);
+        const int last = std::min(x - 1 + span, w);
+        int k = 0;
+        for (; k < first - (x - 1); ++k) dst[k] = src[0];
+        std::memcpy(dst + k, src + first, sizeof(float) * (last - first));
+        for (k += last - first; k < span; ++k) dst[k] = src[w - 1];
+    }
+    const float* up = rows.data();
+    const float* mid = up + span;
+    const float* down = mid + span;
+
+    const FloatBatch lanes = Lanes();
+    const float gradScale = 0.5f * m_ZScale;
+    alignas(64) uint32_t tail[Stride];
+
+    for (int i = 0; i < padded; i += Stride)
+    {
+        const FloatBatch c = FloatBatch::load_unaligned(mid + i + 1);
+        const FloatBatch l = FloatBatch::load_unaligned(mid + i);
+        const FloatBatch r = FloatBatch::load_unaligned(mid + i + 2);
+        const FloatBatch u = FloatBatch::load_unaligned(up + i + 1);
+        const FloatBatch d = FloatBatch::load_unaligned(down + i + 1);
+
+        const FloatBatch gx = (r - l) * gradScale;
+        const FloatBatch gz = (d - u) * gradScale;
+        const FloatBatch slope = xsimd::sqrt(gx * gx + gz * gz);
+        const FloatBatch curvature = (l + r + u + d - 4.0f * c) * m_ZScale;
+        const FloatBatch px = FloatBatch(static_cast<float>(x + i)) + lanes;
+
+        FloatBatch weights[LayerCount];
+        FloatBatch sum(0.0f);
+        for (int k = 0; k < LayerCount; ++k)
+        {
+            if (k >= static_cast<int>(m_Layers.size()))
+            {
+                weights[k] = FloatBatch(0.0f);
+                continue;
+            }
+
+            const auto& layer = m_Layers[k];
+            FloatBatch v = Band(c, layer.Min[0], layer.Max[0], layer.InvFade[0]) *
+                Band(slope, layer.Min[1], layer.Max[1], layer.InvFade[1]) *
+                Band(curvature, layer.Min[2], layer.Max[2], layer.InvFade[2]) * layer.Weight;
+            if (layer.NoiseAmount != 0.0f)
+            {
+                // two octaves, the second at twice the frequency and half the amplitude
+                const float py = static_cast<float>(y) * layer.Frequency;
+                const FloatBatch n = ValueNoise(px * layer.Frequency, py, layer.Seed) * (2.0f / 3.0f) +
+                    ValueNoise(px * (layer.Frequency * 2.0f), py * 2.0f, layer.Seed + 1) * (1.0f / 3.0f);
+                v *= xsimd::max(FloatBatch(0.0f), 1.0f + layer.NoiseAmount * (n * 2.0f - 1.0f));
+            }
+            weights[k] = v;
+            sum += v;
+        }
+
+        // nothing matched, fall back to the first layer
+        const auto covered = sum > 1e-6f;
+        const FloatBatch scale = xsimd::select(covered, 255.0f / sum, FloatBatch(0.0f));
+        weights[0] = xsimd::select(covered, weights[0] * scale, FloatBatch(255.0f));
+        UintBatch packed(0u);
+        for (int k = 0; k < LayerCount; ++k)
+        {
+            const FloatBatch v = k == 0 ? weights[0] : weights[k] * scale;
+            const UintBatch q = xsimd::bitwise_cast<uint32_t>(xsimd::batch_cast<int32_t>(v + 0.5f));
+            packed = packed | q << (8 * k);
+        }
+
+        if (i + Stride <= count)
+        {
+            packed.store_unaligned(out + i);
+        }
+        else
+        {
+            packed.store_aligned(tail);
+            std::memcpy(out + i, tail, sizeof(uint32_t) * (count - i));
+        }
+    }
+}
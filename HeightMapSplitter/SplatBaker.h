@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class Heightmap;
+
+// Weight of one terrain layer, the product of its bands and noise.
+struct SplatRule
+{
+    // full weight inside [Min, Max], fading linearly to zero over Fade outside of it
+    struct Band
+    {
+        float Min = -1e30f;
+        float Max = 1e30f;
+        float Fade = 1.0f;
+    };
+
+    std::string Name;
+    float Weight = 1.0f;
+    Band Altitude;      // normalized height
+    Band Slope;         // rise over run, tan of the slope angle
+    Band Curvature;     // laplacian in world units, positive in valleys
+    float NoiseScale = 64.0f;   // pixels per noise cell
+    float NoiseAmount = 0.0f;   // weight varies by +- amount
+    uint32_t Seed = 0;
+};
+
+// Evaluates up to four splat rules per heightmap pixel and packs the normalized weights as RGBA8,
+// layer i in byte i, the layout the viewer's SplatMap reads.
+// Rows are evaluated SIMD-wide from three clamped source rows, so any span of any row can be baked
+// independently and the caller decides how to tile and parallelize.
+class SplatBaker
+{
+public:
+    static constexpr int LayerCount = 4;
+
+    SplatBaker(const Heightmap& heightmap, float zScale, std::vector<SplatRule> rules);
+
+    // grass everywhere, dirt in hollows, rock on steep slopes, snow up high
+    static std::vector<SplatRule> DefaultRules();
+
+    // { "layers": [ { "name", "weight", "altitude": { "min", "max", "fade" }, "slope": {...},
+    //   "curvature": {...}, "noise": { "scale", "amount", "seed" } } ] }
+    static std::vector<SplatRule> LoadRules(const std::filesystem::path& path);
+
+    // packed weights of pixels [x, x + count) of row y
+    void EvaluateRow(int x, int y, int count, uint32_t* out) const;
+
+private:
+    struct Layer
+    {
+        float Weight;
+        std::array<float, 3> Min;
+        std::array<float, 3> Max;
+        std::array<float, 3> InvFade;
+        float Frequency;
+        float NoiseAmount;
+        uint32_t Seed;
+    };
+
+    const Heightmap& m_Heightmap;
+    const float m_ZScale;
+    std::vector<Layer> m_Layers;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Runs tasks on g_ThreadPool in dependency order. A task is queued the moment its last predecessor
+// finishes, so there is no barrier between stages: independent chains keep every worker busy.
+// Of the tasks ready at once the one with the highest priority runs first, equal priorities in the order
+// they were added. After a task throws, the tasks still pending are skipped and Run() rethrows the first error.
+class TaskGraph
+{
+public:
+    using TaskId = int;
+
+    TaskId Add(std::function<void()> work)
+    {
+        m_Nodes.push_back(std::make_unique<Node>());
+        m_Nodes.back()->Work = std::move(work);
+        return static_cast<TaskId>(m_Nodes.size() - 1);
+    }
+
+    // after starts once before has finished
+    void Precede(const TaskId before, const TaskId after)
+    {
+        m_Nodes[before]->Successors.push_back(after);
+        ++m_Nodes[after]->PredecessorCount;
+    }
+
+    // higher runs earlier among the ready tasks, 0 by default
+    void SetPriority(const TaskId id, const double priority)
+    {
+        m_Nodes[id]->Priority = priority;
+    }
+
+    [[nodiscard]] size_t Size() const { return m_Nodes.size(); }
+
+    // runs every task once and blocks until all have finished, the graph can not be run again
+    void Run()
+    {
+        if (m_Nodes.empty()) return;
+        for (auto& node : m_Nodes)
+            node->Pending = node->PredecessorCount;
+        m_Done = 0;
+        for (TaskId id = 0; id < static_cast<TaskId>(m_Nodes.size()); ++id)
+            if (m_Nodes[id]->PredecessorCount == 0) Submit(id);
+
+        std::unique_lock lock(m_Mutex);
+        m_Cv.wait(lock, [this] { return m_Done == m_Nodes.size(); });
+        if (m_Error) std::rethrow_exception(m_Error);
+    }
+
+private:
+    struct Node
+    {
+        std::function<void()> Work;
+        std::vector<TaskId> Successors;
+        int PredecessorCount = 0;
+        double Priority = 0.0;
+        std::atomic<int> Pending { 0 };
+    };
+
+    struct Ready
+    {
+        double Priority;
+        TaskId Id;
+
+        bool operator<(const Ready& other) const
+        {
+            return Priority < other.Priority || (Priority == other.Priority && Id > other.Id);
+        }
+    };
+
+    // every pool job runs whichever ready task ranks first when a worker picks it up
+    void Submit(const TaskId id)
+    {
+        {
+            std::lock_guard lock(m_ReadyMutex);
+            m_Ready.push({ m_Nodes[id]->Priority, id });
+        }
+        g_ThreadPool.enqueue([this] { Execute(Next()); });
+    }
+
+    TaskId Next()
+    {
+        std::lock_guard lock(m_ReadyMutex);
+        const TaskId id = m_Ready.top().Id;
+        m_Ready.pop();
+        return id;
+    }
+
+    void Execute(const TaskId id)
+    {
+        auto& node = *m_Nodes[id];
+        if (!m_Failed)
+        {
+            try
+            {
+                node.Work();
+            }
+            catch (...)
+            {
+                std::lock_guard lock(m_Mutex);
+                if (!m_Error) m_Error = std::current_exception();
+                m_Failed = true;
+            }
+        }
+        // release captured state early, a finished task's closure may own large buffers
+        node.Work = nullptr;
+
+        for (const TaskId next : node.Successors)
+            if (--m_Nodes[next]->Pending == 0) Submit(next);
+
+        // counted under the lock, Run() may return and destroy the graph as soon as it sees the last one
+        std::lock_guard lock(m_Mutex);
+        if (++m_Done == m_Nodes.size()) m_Cv.notify_all();
+    }
+
+    std::vector<std::unique_ptr<Node>> m_Nodes;
+    std::priority_queue<Ready> m_Ready;
+    std::mutex m_ReadyMutex;
+    size_t m_Done = 0;
+    std::atomic<bool> m_Failed { false };
+    std::mutex m_Mutex;
+    std::condition_variable m_Cv;
+    std::exception_ptr m_Error;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdexcept>
+
+// The grid of source tiles the viewer streams: tilesX x tilesY tiles of one size, tile i = ty * tilesX + tx
+// at (tx * TileWidth, ty * TileHeight). What the tile counts do not divide is cropped off the right and the
+// bottom, the viewer repeats equal tiles and has no room for odd ones. Everything written per tile, the
+// height, normal and splat tiles as much as the AO, cuts along this grid so the tiles of one index line up.
+struct TileLayout
+{
+    int TilesX = 0;
+    int TilesY = 0;
+    int TileWidth = 0;
+    int TileHeight = 0;
+
+    TileLayout(const int width, const int height, const int tilesX, const int tilesY) :
+        TilesX(tilesX), TilesY(tilesY)
+    {
+        if (tilesX <= 0 || tilesY <= 0 || width < tilesX || height < tilesY)
+            throw std::runtime_error("invalid source tile grid");
+        TileWidth = width / tilesX;
+        TileHeight = height / tilesY;
+    }
+
+    [[nodiscard]] int Index(const int tx, const int ty) const { return ty * TilesX + tx; }
+    [[nodiscard]] int OriginX(const int tx) const { return tx * TileWidth; }
+    [[nodiscard]] int OriginY(const int ty) const { return ty * TileHeight; }
+
+    // the area the tiles cover, the viewer's world before it repeats
+    [[nodiscard]] int Width() const { return TilesX * TileWidth; }
+    [[nodiscard]] int Height() const { return TilesY * TileHeight; }
+};
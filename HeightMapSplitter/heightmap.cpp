@@ -1,10 +1,15 @@
 #include "heightmap.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/normal.hpp>
 #include <glm/gtx/polar_coordinates.hpp>
 
 #include "blur.h"
+#include "BuildCache.h"
+#include "PngWriter.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -47,63 +52,92 @@ Heightmap::Heightmap(
     m_Height(height),
     m_Data(data) {}
 
-void Heightmap::AutoLevel()
+void Heightmap::SetMask(std::vector<uint8_t> mask)
 {
-    float lo = m_Data[0];
-    float hi = m_Data[0];
-    for (int i = 0; i < m_Data.size(); i++)
-    {
-        lo = std::min(lo, m_Data[i]);
-        hi = std::max(hi, m_Data[i]);
-    }
-    if (hi == lo)
+    if (!mask.empty() && mask.size() != m_Data.size())
+        throw std::runtime_error("mask does not match the heightmap size");
+    m_Mask = std::move(mask);
+}
+
+void Heightmap::MaskImage(const std::string& path)
+{
+    int w, h, c;
+    uint8_t* data = stbi_load(path.c_str(), &w, &h, &c, 1);
+    if (!data)
+        throw std::runtime_error("failed to load mask " + path);
+    if (w != m_Width || h != m_Height)
     {
-        return;
+        free(data);
+        throw std::runtime_error("mask " + path + " is not " + std::to_string(m_Width) + " x " +
+            std::to_string(m_Height));
     }
-    for (int i = 0; i < m_Data.size(); i++)
+    m_Mask.resize(m_Data.size());
+    for (size_t i = 0; i < m_Mask.size(); ++i)
+        m_Mask[i] |= data[i] == 0;
+    free(data);
+}
+
+void Heightmap::MaskBelow(const float level)
+{
+    m_Mask.resize(m_Data.size());
+    for (size_t i = 0; i < m_Mask.size(); ++i)
+        m_Mask[i] |= m_Data[i] <= level;
+}
+
+size_t Heightmap::MaskedCount() const
+{
+    return static_cast<size_t>(std::count_if(m_Mask.begin(), m_Mask.end(), [](const uint8_t m) { return m != 0; }));
+}
+
+bool Heightmap::FullyMasked() const
+{
+    return !m_Mask.empty() && MaskedCount() == m_Mask.size();
+}
+
+bool Heightmap::Covers(const glm::ivec2 p0, const glm::ivec2 p1, const glm::ivec2 p2) const
+{
+    if (m_Mask.empty()) return true;
+    const glm::ivec2 min = glm::min(glm::min(p0, p1), p2);
+    const glm::ivec2 max = glm::max(glm::max(p0, p1), p2);
+    for (int y = min.y; y <= max.y; ++y)
     {
-        m_Data[i] = (m_Data[i] - lo) / (hi - lo);
+        for (int x = min.x; x <= max.x; ++x)
+        {
+            // edge functions of one sign inside, whichever way the triangle winds
+            const int w0 = (p1.x - x) * (p2.y - y) - (p1.y - y) * (p2.x - x);
+            const int w1 = (p2.x - x) * (p0.y - y) - (p2.y - y) * (p0.x - x);
+            const int w2 = (p0.x - x) * (p1.y - y) - (p0.y - y) * (p1.x - x);
+            if ((w0 < 0 || w1 < 0 || w2 < 0) && (w0 > 0 || w1 > 0 || w2 > 0)) continue;
+            if (!m_Mask[y * m_Width + x]) return true;
+        }
     }
+    return false;
+}
+
+void Heightmap::AutoLevel()
+{
+    Process().AutoLevel().Run();
 }
 
 void Heightmap::Invert()
 {
-    for (int i = 0; i < m_Data.size(); i++)
-    {
-        m_Data[i] = 1.f - m_Data[i];
-    }
+    Process().Invert().Run();
 }
 
 void Heightmap::GammaCurve(const float gamma)
 {
-    for (int i = 0; i < m_Data.size(); i++)
-    {
-        m_Data[i] = std::pow(m_Data[i], gamma);
-    }
+    Process().GammaCurve(gamma).Run();
 }
 
 void Heightmap::AddBorder(const int size, const float z)
 {
-    const int w = m_Width + size * 2;
-    const int h = m_Height + size * 2;
-    std::vector<float> data(w * h, z);
-    int i = 0;
-    for (int y = 0; y < m_Height; y++)
-    {
-        int j = (y + size) * w + size;
-        for (int x = 0; x < m_Width; x++)
-        {
-            data[j++] = m_Data[i++];
-        }
-    }
-    m_Width = w;
-    m_Height = h;
-    m_Data = data;
+    Process().AddBorder(size, z).Run();
 }
 
 void Heightmap::GaussianBlur(const int r)
 {
     m_Data = ::GaussianBlur(m_Data, m_Width, m_Height, r);
+    m_Pyramid.reset();
 }
 
 std::vector<glm::vec3> Heightmap::Normalmap(const float zScale) const
@@ -146,18 +180,17 @@ void Heightmap::SaveNormalmap(
     const float zScale) const
 {
     const std::vector<glm::vec3> nm = Normalmap(zScale);
-    std::vector<uint8_t> data(nm.size() * 3);
-    int i = 0;
-    for (glm::vec3 n : nm)
+    const int w = m_Width - 1;
+    PngWriter(path, w, m_Height - 1, 3).Write([&nm, w](const int y, uint8_t* row)
     {
-        n = (n + 1.f) / 2.f;
-        data[i++] = uint8_t(n.x * 255);
-        data[i++] = uint8_t(n.y * 255);
-        data[i++] = uint8_t(n.z * 255);
-    }
-    stbi_write_png(
-        path.c_str(), m_Width - 1, m_Height - 1, 3,
-        data.data(), (m_Width - 1) * 3);
+        for (int x = 0; x < w; ++x)
+        {
+            const glm::vec3 n = (nm[y * w + x] + 1.f) / 2.f;
+            row[x * 3 + 0] = uint8_t(n.x * 255);
+            row[x * 3 + 1] = uint8_t(n.y * 255);
+            row[x * 3 + 2] = uint8_t(n.z * 255);
+        }
+    });
 }
 
 void Heightmap::SaveHillshade(
@@ -169,18 +202,17 @@ void Heightmap::SaveHillshade(
     const glm::vec3 light = glm::euclidean(glm::vec2(
         glm::radians(altitude), glm::radians(-azimuth))).xzy();
     const std::vector<glm::vec3> nm = Normalmap(zScale);
-    std::vector<uint8_t> data(nm.size() * 3);
-    int i = 0;
-    for (glm::vec3 n : nm)
+    const int w = m_Width - 1;
+    PngWriter(path, w, m_Height - 1, 3).Write([&nm, &light, w](const int y, uint8_t* row)
     {
-        const uint8_t d = glm::clamp(glm::dot(n, light), 0.f, 1.f) * 255;
-        data[i++] = d;
-        data[i++] = d;
-        data[i++] = d;
-    }
-    stbi_write_png(
-        path.c_str(), m_Width - 1, m_Height - 1, 3,
-        data.data(), (m_Width - 1) * 3);
+        for (int x = 0; x < w; ++x)
+        {
+            const uint8_t d = glm::clamp(glm::dot(nm[y * w + x], light), 0.f, 1.f) * 255;
+            row[x * 3 + 0] = d;
+            row[x * 3 + 1] = d;
+            row[x * 3 + 2] = d;
+        }
+    });
 }
 
 void Heightmap::SaveDds(const std::wstring& path) const
@@ -202,28 +234,6 @@ void Heightmap::SaveDds(const std::wstring& path) const
     SaveToDDSFile(img, DirectX::DDS_FLAGS_NONE, (path + L"/height.dds").c_str());
 }
 
-std::vector<std::vector<std::shared_ptr<Heightmap>>> Heightmap::SplitIntoPatches(int patchSize) const
-{
-    const int nx = m_Width / (patchSize - 1);
-    const int ny = m_Height / (patchSize - 1);
-    std::vector patches(nx, std::vector<std::shared_ptr<Heightmap>>(ny));
-    for (int i = 0; i < nx; ++i)
-    {
-        for (int j = 0; j < ny; ++j)
-        {
-            std::vector<float> data(patchSize * patchSize);
-            for (int k = 0; k < patchSize * patchSize; ++k)
-            {
-                const int x = k % patchSize + i * (patchSize - 1);
-                const int y = k / patchSize + j * (patchSize - 1);
-                data[k] = At(x, y);
-            }
-            patches[j][i] = std::make_shared<Heightmap>(patchSize, patchSize, data);
-        }
-    }
-    return patches;
-}
-
 std::pair<glm::ivec2, float> Heightmap::FindCandidate(
     const glm::ivec2 p0,
     const glm::ivec2 p1,
@@ -256,6 +266,9 @@ std::pair<glm::ivec2, float> Heightmap::FindCandidate(
     const float z1 = At(p1) / a;
     const float z2 = At(p2) / a;
 
+    // masked pixels are inside but never off
+    const uint8_t* mask = m_Mask.empty() ? nullptr : m_Mask.data();
+
     // iterate over pixels in bounding box
     float maxError = 0;
     glm::ivec2 maxPoint(0);
@@ -288,6 +301,13 @@ std::pair<glm::ivec2, float> Heightmap::FindCandidate(
             if (w0 >= 0 && w1 >= 0 && w2 >= 0)
             {
                 wasInside = true;
+                if (mask && mask[y * m_Width + x])
+                {
+                    w0 += a12;
+                    w1 += a20;
+                    w2 += a01;
+                    continue;
+                }
 
                 // compute z using barycentric coordinates
                 const float z = z0 * w0 + z1 * w1 + z2 * w2;
@@ -323,6 +343,13 @@ std::pair<glm::ivec2, float> Heightmap::FindCandidate(
 
 std::pair<float, float> Heightmap::GetBound() const
 {
+    if (m_Pyramid)
+    {
+        const auto b = m_Pyramid->Query(m_PyramidOrigin.x, m_PyramidOrigin.y,
+            m_PyramidOrigin.x + m_Width - 1, m_PyramidOrigin.y + m_Height - 1);
+        return { b.Min, b.Max };
+    }
+
     float min = std::numeric_limits<float>::max();
     float max = std::numeric_limits<float>::min();
     for (float h : m_Data)
@@ -332,3 +359,40 @@ std::pair<float, float> Heightmap::GetBound() const
     }
     return { min, max };
 }
+
+uint64_t Heightmap::Hash() const
+{
+    ContentHash hash;
+    hash.Add(m_Width).Add(m_Height).Add(m_Data);
+    if (!m_Mask.empty()) hash.Add("mask").Add(m_Mask);
+    return hash.Value();
+}
+
+Heightmap::Roughness Heightmap::MeasureRoughness(const int stride) const
+{
+    // A sample's Laplacian at this spacing is its pixels' curvature times the stride squared, so the sum
+    // over the coarse grid stays the sum over every pixel whatever the stride. That only holds for smooth
+    // terrain, noise finer than the stride shows in the Laplacian of the adjacent pixels instead.
+    float min = std::numeric_limits<float>::max();
+    float max = std::numeric_limits<float>::lowest();
+    double laplacian = 0.0;
+    double detail = 0.0;
+    for (int y = 0; y < m_Height; y += stride)
+    {
+        for (int x = 0; x < m_Width; x += stride)
+        {
+            if (Masked(x, y)) continue;
+            const float h = At(x, y);
+            min = std::min(min, h);
+            max = std::max(max, h);
+            if (x < stride || y < stride || x + stride >= m_Width || y + stride >= m_Height) continue;
+            if (Masked(x - stride, y) || Masked(x + stride, y) || Masked(x, y - stride) || Masked(x, y + stride) ||
+                Masked(x - 1, y) || Masked(x + 1, y) || Masked(x, y - 1) || Masked(x, y + 1))
+                continue;
+            laplacian += std::abs(At(x - stride, y) + At(x + stride, y) + At(x, y - stride) + At(x, y + stride) -
+                4.0f * h);
+            detail += std::abs(At(x - 1, y) + At(x + 1, y) + At(x, y - 1) + At(x, y + 1) - 4.0f * h);
+        }
+    }
+    return { min <= max ? max - min : 0.0f, laplacian, detail * stride * stride };
+}
@@ -1,12 +1,16 @@
 #pragma once
 
 #define GLM_FORCE_SWIZZLE
+#include <cstdint>
 #include <memory>
 #include <glm/glm.hpp>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "HeightPyramid.h"
+#include "PointPipeline.h"
+
 class Heightmap
 {
 public:
@@ -37,6 +41,40 @@ public:
         return m_Data[p.y * m_Width + p.x];
     }
 
+    // Optional no-data and water mask, a non-zero byte per pixel. Masked pixels add no error to
+    // FindCandidate and no roughness, the triangulator leaves out triangles covering masked pixels only.
+    // The mask survives the point ops and is split along with the patches.
+    void SetMask(std::vector<uint8_t> mask);
+
+    // masks the black pixels of an 8 bit image the size of the map, on top of what is masked already
+    void MaskImage(const std::string& path);
+
+    // masks every pixel at or below level, the sea
+    void MaskBelow(float level);
+
+    bool HasMask() const
+    {
+        return !m_Mask.empty();
+    }
+
+    bool Masked(const int x, const int y) const
+    {
+        return !m_Mask.empty() && m_Mask[y * m_Width + x];
+    }
+
+    const std::vector<uint8_t>& Mask() const { return m_Mask; }
+
+    size_t MaskedCount() const;
+
+    // every pixel masked, nothing to triangulate
+    bool FullyMasked() const;
+
+    // whether any pixel of the triangle, its edges included, is not masked
+    bool Covers(glm::ivec2 p0, glm::ivec2 p1, glm::ivec2 p2) const;
+
+    // Chain point ops and run them in one fused pass, e.g. Process().Invert().AutoLevel().Run().
+    PointPipeline Process() { return PointPipeline(*this); }
+
     void AutoLevel();
 
     void Invert();
@@ -58,17 +96,40 @@ public:
 
     void SaveDds(const std::wstring& path) const;
 
-    std::vector<std::vector<std::shared_ptr<Heightmap>>> SplitIntoPatches(int patchSize) const;
-
     std::pair<glm::ivec2, float> FindCandidate(
         const glm::ivec2 p0,
         const glm::ivec2 p1,
         const glm::ivec2 p2) const;
 
+    std::shared_ptr<const HeightPyramid> Pyramid() const { return m_Pyramid; }
+
     std::pair<float, float> GetBound() const;
 
+    // content hash of size and samples, the key of everything built from this map
+    uint64_t Hash() const;
+
+    // Cheap statistics from every stride-th sample, what the triangulation cost is predicted from.
+    struct Roughness
+    {
+        float Range = 0.0f;         // max - min of the samples
+        double Laplacian = 0.0;     // sum of |Laplacian| over the samples, 4 neighbours stride apart
+        double Detail = 0.0;        // the same with the neighbours next to the sample, times stride squared
+    };
+
+    Roughness MeasureRoughness(int stride = 4) const;
+
+    friend class HeightStore;
+    friend class PointPipeline;
+    friend class HorizonBaker;
+    friend class SplatBaker;
+
 private:
     int m_Width;
     int m_Height;
     std::vector<float> m_Data;
+    std::vector<uint8_t> m_Mask;    // empty when nothing is masked
+
+    // source pyramid and where this map sits in it, reset whenever m_Data changes
+    std::shared_ptr<const HeightPyramid> m_Pyramid = nullptr;
+    glm::ivec2 m_PyramidOrigin { 0 };
 };
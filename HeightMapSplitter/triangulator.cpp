@@ -8,7 +8,7 @@
 #include "SideCutter.h"
 
 Triangulator::Triangulator(
-    std::shared_ptr<Heightmap> heightmap,
+    std::shared_ptr<const Heightmap> heightmap,
     float error, int nTri, int nVert) :
     m_Heightmap(std::move(heightmap)), m_MaxError(error), m_MaxTriangles(nTri), m_MaxPoints(nVert) {}
 
@@ -104,8 +104,11 @@ std::vector<Triangulator::PackedMesh> Triangulator::RunLod(TriangleCountHeap tri
 
         ib.reserve(m_Queue.size() * 3);
         for (const int i : m_Queue)
+        {
+            if (Void(i)) continue;
             for (int j = 0; j < 3; ++j)
                 ib.emplace_back(static_cast<uint32_t>(m_Triangles[i * 3 + j]));
+        }
 
         //SideCutter::Cut(mesh, m_Heightmap->Width(), [](const PackedPoint& p) { return true; });
         lods.emplace_back(mesh);
@@ -148,8 +151,11 @@ std::vector<Triangulator::PackedMesh> Triangulator::RunLod(ErrorHeap errors)
 
         ib.reserve(m_Queue.size() * 3);
         for (const int i : m_Queue)
+        {
+            if (Void(i)) continue;
             for (int j = 0; j < 3; ++j)
                 ib.emplace_back(static_cast<uint32_t>(m_Triangles[i * 3 + j]));
+        }
 
         //SideCutter::Cut(mesh, m_Heightmap->Width(), [](const PackedPoint& p) { return true; });
         lods.emplace_back(mesh);
@@ -273,6 +279,7 @@ std::vector<glm::ivec3> Triangulator::Triangles() const
     triangles.reserve(m_Queue.size());
     for (const int i : m_Queue)
     {
+        if (Void(i)) continue;
         triangles.emplace_back(
             m_Triangles[i * 3 + 0],
             m_Triangles[i * 3 + 1],
@@ -300,8 +307,27 @@ void Triangulator::Flush()
     m_Pending.clear();
 }
 
+bool Triangulator::Void(const int t) const
+{
+    // Triangles reaching the border stay, so every border vertex keeps its triangles and the seams, the
+    // rivets and the stitching strips come out as without the mask. Only unmasked pixels add error, so
+    // only triangles without any need the raster.
+    if (!m_Heightmap->HasMask() || m_Errors[t] > 0) return false;
+    const int x1 = m_Heightmap->Width() - 1;
+    const int y1 = m_Heightmap->Height() - 1;
+    glm::ivec2 p[3];
+    for (int j = 0; j < 3; ++j)
+    {
+        p[j] = m_Points[m_Triangles[t * 3 + j]];
+        if (p[j].x == 0 || p[j].y == 0 || p[j].x == x1 || p[j].y == y1) return false;
+    }
+    return !m_Heightmap->Covers(p[0], p[1], p[2]);
+}
+
 void Triangulator::Step()
 {
+    ++m_Steps;
+
     // pop triangle with highest error from priority queue
     const int t = QueuePop();
 
@@ -517,6 +543,7 @@ void Triangulator::Legalize(const int a)
         return;
     }
 
+    ++m_Flips;
     const int hal = m_Halfedges[al];
     const int har = m_Halfedges[ar];
     const int hbl = m_Halfedges[bl];
@@ -40,7 +40,7 @@ public:
     using PackedMesh = std::pair<std::vector<PackedPoint>, std::vector<uint32_t>>;
 
     Triangulator(
-        std::shared_ptr<Heightmap> heightmap,
+        std::shared_ptr<const Heightmap> heightmap,
         float error, int nTri, int nVert);
 
     void Initialize();
@@ -63,6 +63,17 @@ public:
         return m_Queue.size();
     }
 
+    // refinement steps taken and Delaunay edge flips made so far, for the build report
+    int64_t Steps() const
+    {
+        return m_Steps;
+    }
+
+    int64_t Flips() const
+    {
+        return m_Flips;
+    }
+
     float Error() const;
     std::vector<glm::vec3> Points(const float zScale) const;
     std::vector<glm::ivec3> Triangles() const;
@@ -70,6 +81,9 @@ public:
 private:
     void Flush();
 
+    // covers masked pixels only and stays off the patch border, left out of every mesh handed out
+    bool Void(int t) const;
+
     void Step();
 
     int AddPoint(const glm::ivec2 point);
@@ -90,7 +104,7 @@ private:
     void QueueUp(const int j0);
     bool QueueDown(const int i0, const int n);
 
-    std::shared_ptr<Heightmap> m_Heightmap;
+    std::shared_ptr<const Heightmap> m_Heightmap;
 
     std::vector<glm::ivec2> m_Points;
     std::vector<int> m_Triangles;
@@ -107,6 +121,9 @@ private:
     const float m_MaxError;
     const int m_MaxTriangles;
     const int m_MaxPoints;
+
+    int64_t m_Steps = 0;
+    int64_t m_Flips = 0;
 };
 
 namespace std
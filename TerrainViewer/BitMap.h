@@ -102,10 +102,12 @@ namespace DirectX
     class TiledMap
     {
     public:
-        TiledMap(std::vector<std::shared_ptr<T>> src) : m_Sources(std::move(src)),
+        // sources are row major, tile (tx, ty) at ty * tilesX + tx
+        TiledMap(std::vector<std::shared_ptr<T>> src, const unsigned tilesX = 2, const unsigned tilesY = 2) :
+            m_Sources(std::move(src)), m_TilesX(tilesX), m_TilesY(tilesY),
             m_Width(m_Sources[0]->GetMetadata().width), m_Height(m_Sources[0]->GetMetadata().height)
         {
-            if (m_Sources.size() != TILE_X * TILE_Y)
+            if (m_Sources.size() != m_TilesX * m_TilesY)
                 throw std::exception("Tiled map size mismatch");
             for (auto&& map : m_Sources)
 
@@ -117,9 +119,9 @@ namespace DirectX
 
         [[nodiscard]] auto& GetVal(int x, int y, const int m) const
         {
-            const auto tx = WarpMod(x / GetMipWidth(m), TILE_X);
-            const auto ty = WarpMod(y / GetMipHeight(m), TILE_Y);
-            const auto ti = ty * TILE_X + tx;
+            const auto tx = WarpMod(x / GetMipWidth(m), m_TilesX);
+            const auto ty = WarpMod(y / GetMipHeight(m), m_TilesY);
+            const auto ti = ty * m_TilesX + tx;
             return m_Sources[ti]->GetVal(x, y, m);
         }
 
@@ -133,6 +135,17 @@ namespace DirectX
             return m_Height >> mip;
         }
 
+        // size of the whole tiled area before it repeats
+        [[nodiscard]] size_t GetTotalWidth(const size_t mip) const
+        {
+            return GetMipWidth(mip) * m_TilesX;
+        }
+
+        [[nodiscard]] size_t GetTotalHeight(const size_t mip) const
+        {
+            return GetMipHeight(mip) * m_TilesY;
+        }
+
         [[nodiscard]] auto CopyRectangle(
             const int x, const int y, const size_t w, const size_t h, const size_t m) const
         {
@@ -148,9 +161,9 @@ namespace DirectX
         }
 
     protected:
-        static constexpr unsigned TILE_X = 2;
-        static constexpr unsigned TILE_Y = 2;
         std::vector<std::shared_ptr<T>> m_Sources {};
+        unsigned m_TilesX = 2;
+        unsigned m_TilesY = 2;
         unsigned m_Width = 0;
         unsigned m_Height = 0;
     };
@@ -1,6 +1,8 @@
 #define NOMINMAX
 #include "BitmapManager.h"
 
+#include <atomic>
+
 #include "BitMap.h"
 #include "ClipmapLevel.h"
 #include "ispc_texcomp.h"
@@ -26,6 +28,11 @@ void BitmapManager::BindMaterial(
     m_HgtAtlas = hgt;
 }
 
+void BitmapManager::BindVirtualTexture(std::shared_ptr<const VirtualTextureReader> baked)
+{
+    std::atomic_store(&m_Baked, std::move(baked));
+}
+
 std::vector<uint16_t> BitmapManager::CopyElevation(int x, int y, unsigned w, unsigned h, int mip) const
 {
     const auto begin = std::chrono::steady_clock::now();
@@ -43,6 +50,8 @@ std::vector<uint32_t> BitmapManager::BlendAlbedoRoughness(int x, int y, unsigned
 
 std::vector<uint8_t> BitmapManager::BlendAlbedoRoughnessBc3(int x, int y, unsigned w, unsigned h, int mip) const
 {
+    if (const auto baked = std::atomic_load(&m_Baked); baked && mip < baked->LevelCount())
+        return baked->Copy(VirtualTexture::Albedo, x, y, w, h, mip);
     return CompressRgba8ToBc3(BlendAlbedoRoughness(x, y, w, h, mip).data(),
         w * AlbedoBlender::SampleRatio, h * AlbedoBlender::SampleRatio);
 }
@@ -57,6 +66,9 @@ std::vector<uint32_t> BitmapManager::BlendNormalOcclusion(
 std::vector<uint8_t> BitmapManager::BlendNormalOcclusionBc3(
     int x, int y, unsigned w, unsigned h, int mip, int method) const
 {
+    if (const auto baked = std::atomic_load(&m_Baked);
+        baked && mip < baked->LevelCount() && static_cast<uint32_t>(method) == baked->Header().BlendMethod)
+        return baked->Copy(VirtualTexture::Normal, x, y, w, h, mip);
     return CompressRgba8ToBc3(BlendNormalOcclusion(x, y, w, h, mip, method).data(),
         w * NormalBlender::SampleRatio, h * NormalBlender::SampleRatio);
 }
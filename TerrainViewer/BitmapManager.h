@@ -4,6 +4,7 @@
 
 #include "BitMap.h"
 #include "Texture2D.h"
+#include "VirtualTextureReader.h"
 
 class BitmapManager
 {
@@ -23,6 +24,10 @@ public:
         const std::vector<std::shared_ptr<DirectX::NormalMap>>& nor, const std::vector<std::shared_ptr<DirectX::HeightMap>>&
         hgt);
 
+    // the Bc3 blends of the levels baked are copied from baked while its blend method is asked for,
+    // nullptr blends everything live again
+    void BindVirtualTexture(std::shared_ptr<const VirtualTextureReader> baked);
+
     [[nodiscard]] std::vector<uint16_t> CopyElevation(
         int x, int y, unsigned w, unsigned h, int mip) const;
     [[nodiscard]] std::vector<uint32_t> BlendAlbedoRoughness(
@@ -34,6 +39,8 @@ public:
     [[nodiscard]] std::vector<uint8_t> BlendNormalOcclusionBc3(
         int x, int y, unsigned w, unsigned h, int mip, int method) const;
     [[nodiscard]] float GetPixelHeight(int x, int y, int mip) const;
+    [[nodiscard]] size_t GetSplatWidth(const int mip) const { return m_SplatTiles->GetTotalWidth(mip); }
+    [[nodiscard]] size_t GetSplatHeight(const int mip) const { return m_SplatTiles->GetTotalHeight(mip); }
 
 protected:
     [[nodiscard]] static std::vector<uint8_t> CompressRgba8ToBc3(uint32_t* src, unsigned w, unsigned h);
@@ -45,4 +52,5 @@ protected:
     std::vector<std::shared_ptr<DirectX::AlbedoMap>> m_AlbAtlas { nullptr };
     std::vector<std::shared_ptr<DirectX::NormalMap>> m_NorAtlas { nullptr };
     std::vector<std::shared_ptr<DirectX::HeightMap>> m_HgtAtlas { nullptr };
+    std::shared_ptr<const VirtualTextureReader> m_Baked = nullptr;    // swapped atomically, streams read it
 };
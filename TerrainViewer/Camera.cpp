@@ -5,6 +5,7 @@
 
 #include "Patch.h"
 #include "D3DHelper.h"
+#include "../HeightMapSplitter/ThreadPool.h"
 
 using namespace DirectX;
 using namespace SimpleMath;
@@ -15,8 +16,7 @@ void SaveBin(const std::filesystem::path& path, const std::vector<T>& data)
     std::ofstream ofs(path, std::ios::binary | std::ios::out);
     if (!ofs)
         throw std::runtime_error("failed to open " + path.u8string());
-    for (const auto& v : data)
-        ofs.write(reinterpret_cast<const char*>(&v), sizeof(T));
+    ofs.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
     ofs.close();
     std::printf("%s generated\n", path.u8string().c_str());
 }
@@ -162,8 +162,19 @@ void Camera::StopRecord()
     m_IsPlaying = false;
     if (!m_RcdRotations.empty())
     {
-        SaveBin("CameraPositions.bin", m_RcdPositions);
-        SaveBin("CameraRotations.bin", m_RcdRotations);
+        // off the render thread, the recording is handed over whole
+        g_ThreadPool.enqueue([positions = std::move(m_RcdPositions), rotations = std::move(m_RcdRotations)]
+        {
+            try
+            {
+                SaveBin("CameraPositions.bin", positions);
+                SaveBin("CameraRotations.bin", rotations);
+            }
+            catch (const std::exception& e)
+            {
+                std::fprintf(stderr, "%s\n", e.what());
+            }
+        });
     }
     m_RcdPositions.clear();
     m_RcdRotations.clear();
@@ -151,6 +151,11 @@ void ClipmapLevel::BindSourceManager(
     s_SrcManager = srcMgr;
 }
 
+void ClipmapLevel::BindHeightPyramid(const std::shared_ptr<HeightPyramid>& pyramid)
+{
+    s_HeightPyramid = pyramid;
+}
+
 void ClipmapLevel::BindTexture(
     const std::shared_ptr<ClipmapTexture>& height,
     const std::shared_ptr<ClipmapTexture>& albedo,
@@ -405,10 +410,21 @@ Vector2 ClipmapLevel::GetFinerUvOffset(const Vector2& finerWld) const
 bool ClipmapLevel::IsBlockVisible(const Vector2& world, const BoundingFrustum& frustum, float scl) const
 {
     using Trait = FootprintTrait<Block>;
-    constexpr float min = 0.1;
-    constexpr float max = 0.5;
-    constexpr float avg = (min + max) * 0.5f;
-    constexpr float diff = max - min;
+    float min = 0.1f;
+    float max = 0.5f;
+    if (s_HeightPyramid)
+    {
+        // source pixels are one world unit apart, the block spans (M - 1) grid cells
+        const int x0 = static_cast<int>(std::floor(world.x));
+        const int y0 = static_cast<int>(std::floor(world.y));
+        const int x1 = static_cast<int>(std::ceil(world.x + Trait::Extent.x * 2.0f * m_GridSpacing));
+        const int y1 = static_cast<int>(std::ceil(world.y + Trait::Extent.y * 2.0f * m_GridSpacing));
+        const auto b = s_HeightPyramid->QueryPeriodic(x0, y0, x1, y1);
+        min = b.Min;
+        max = b.Max;
+    }
+    const float avg = (min + max) * 0.5f;
+    const float diff = max - min;
     const auto center = Vector3(
         world.x + Trait::Extent.x * m_GridSpacing,
         avg * scl,
@@ -7,6 +7,7 @@
 #include <future>
 
 #include "BitmapManager.h"
+#include "../HeightMapSplitter/HeightPyramid.h"
 #include "MaterialBlender.h"
 #include "Texture2D.h"
 #include "Vertex.h"
@@ -59,6 +60,7 @@ public:
     ~ClipmapLevel() = default;
 
     static void BindSourceManager(const std::shared_ptr<BitmapManager>& srcMgr);
+    static void BindHeightPyramid(const std::shared_ptr<HeightPyramid>& pyramid);
     static void BindTexture(
         const std::shared_ptr<DirectX::ClipmapTexture>& height,
         const std::shared_ptr<DirectX::ClipmapTexture>& albedo,
@@ -137,6 +139,7 @@ protected:
     using ResultRgba8888 = std::future<DirectX::ClipmapTexture::UpdateArea<uint32_t>>;
 
     inline static std::shared_ptr<BitmapManager> s_SrcManager {};
+    inline static std::shared_ptr<HeightPyramid> s_HeightPyramid {};
     inline static std::shared_ptr<DirectX::ClipmapTexture> s_HeightTex = nullptr;
     inline static std::shared_ptr<DirectX::ClipmapTexture> s_AlbedoTex = nullptr;
     inline static std::shared_ptr<DirectX::ClipmapTexture> s_NormalTex = nullptr;
@@ -0,0 +1,50 @@
+#include "ClusterCuller.h"
+
+#include <cmath>
+
+using namespace DirectX;
+using namespace SimpleMath;
+
+void ClusterCuller::Cull(const PatchArchive::Cluster* clusters, const uint32_t count,
+    const Vector3& origin, const BoundingFrustum& frustum, const float yScale, const float bakedScale,
+    std::vector<Range>& ranges, Stats* stats)
+{
+    ranges.clear();
+    const Vector3 eye(frustum.Origin);
+    const bool cones = std::abs(yScale - bakedScale) <= bakedScale * 1e-3f;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const auto& c = clusters[i];
+
+        // x and z from the sphere, y from the height range so the box follows the runtime scale
+        const Vector3 extents(c.Radius, (c.MaxHeight - c.MinHeight) * yScale * 0.5f, c.Radius);
+        const Vector3 center(
+            origin.x + c.Center[0],
+            origin.y + (c.MinHeight + c.MaxHeight) * 0.5f * yScale,
+            origin.z + c.Center[2]);
+        if (frustum.Contains(BoundingBox(center, extents)) == DISJOINT)
+        {
+            if (stats) ++stats->FrustumCulled;
+            continue;
+        }
+
+        if (cones)
+        {
+            const Vector3 toCenter = origin + Vector3(c.Center[0], c.Center[1], c.Center[2]) - eye;
+            if (toCenter.Dot(Vector3(c.ConeAxis[0], c.ConeAxis[1], c.ConeAxis[2])) >=
+                c.ConeCutoff * toCenter.Length() + c.Radius)
+            {
+                if (stats) ++stats->BackfaceCulled;
+                continue;
+            }
+        }
+
+        const uint32_t start = c.IndexOffset;
+        const uint32_t indexCount = c.TriangleCount * 3;
+        if (!ranges.empty() && ranges.back().IndexStart + ranges.back().IndexCount == start)
+            ranges.back().IndexCount += indexCount;
+        else
+            ranges.push_back({ start, indexCount });
+    }
+    if (stats) stats->Clusters += count;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <directxtk/SimpleMath.h>
+
+#include "../HeightMapSplitter/PatchArchive.h"
+
+// CPU culling of the clusters of one patch LOD. Clusters outside the frustum or facing away from the
+// eye are dropped, the survivors come back as index ranges with neighbours merged into one draw.
+class ClusterCuller
+{
+public:
+    struct Range
+    {
+        uint32_t IndexStart;
+        uint32_t IndexCount;
+    };
+
+    struct Stats
+    {
+        uint32_t Clusters = 0;
+        uint32_t FrustumCulled = 0;
+        uint32_t BackfaceCulled = 0;
+    };
+
+    // origin places the patch in the frustum's space, yScale is the height scale the patch is drawn
+    // with. Cone tests only run while it matches the scale the clusters were baked with, at any other
+    // scale the cones no longer describe the surface.
+    static void Cull(const PatchArchive::Cluster* clusters, uint32_t count,
+        const DirectX::SimpleMath::Vector3& origin, const DirectX::BoundingFrustum& frustum,
+        float yScale, float bakedScale, std::vector<Range>& ranges, Stats* stats = nullptr);
+};
@@ -4,6 +4,7 @@
 
 #define NOMINMAX
 
+#include <algorithm>
 #include <chrono>
 #include "imgui_impl_dx11.h"
 #include "imgui_impl_win32.h"
@@ -13,6 +14,7 @@
 
 #include "Texture2D.h"
 #include "TerrainSystem.h"
+#include "VirtualTextureBaker.h"
 #include "../HeightMapSplitter/ThreadPool.h"
 #include <directxtk/GeometricPrimitive.h>
 #include <d3d11_3.h>
@@ -81,6 +83,37 @@ namespace
         { MarsPatch, Mars },
         { ArtificialPatch, Artificial },
     };
+    constexpr int BlendModeInit = NormalBlender::Reorient;
+
+    // --bake-vt [--shard=I/N | --merge=N] bakes asset/vt.pak for the default pack and blend mode, or band I
+    // of N of its tile rows, or joins the N bands, without opening a window
+    int BakeVirtualTexture(const int argc, char** argv)
+    {
+        ShardPlan shard {};
+        int merge = 0;
+        for (int i = 2; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg.rfind("--shard=", 0) == 0)
+            {
+                if (std::sscanf(arg.c_str(), "--shard=%d/%d", &shard.Index, &shard.Count) != 2 ||
+                    shard.Count <= 0 || shard.Index < 0 || shard.Index >= shard.Count)
+                    throw std::runtime_error("expected --shard=I/N with 0 <= I < N");
+            }
+            else if (arg.rfind("--merge=", 0) == 0)
+            {
+                if (std::sscanf(arg.c_str(), "--merge=%d", &merge) != 1 || merge <= 0)
+                    throw std::runtime_error("expected --merge=N");
+            }
+            else throw std::runtime_error("unknown option " + arg);
+        }
+        if (shard.Count && merge)
+            throw std::runtime_error("--shard and --merge are separate steps");
+
+        if (merge) VirtualTextureBaker::Merge("asset", merge);
+        else TerrainSystem::BakeVirtualTexture("asset", MaterialPackages.at(PackIndex), BlendModeInit, shard);
+        return 0;
+    }
 }
 
 // Forward declarations of helper functions
@@ -93,8 +126,21 @@ void CreateSystem();
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 // Main code
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--bake-vt")
+    {
+        try
+        {
+            return BakeVirtualTexture(argc, argv);
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+    }
+
     // Create application window
     //ImGui_ImplWin32_EnableDpiAwareness();
     WNDCLASSEXW wc = {
@@ -150,7 +196,7 @@ int main(int, char**)
     float spd = 30.0f;
     float hScale = 2129.92f;
     float transition = 25.4f;
-    int blendMode = 6;
+    int blendMode = BlendModeInit;
     bool done = false;
     float ambient = 0.2f;
     bool rcd = false;
@@ -183,6 +229,9 @@ int main(int, char**)
 
         ImGui::Begin("Terrain System");
         ImGui::Text("Frame Rate : %f", io.Framerate);
+        const auto decode = Patch::GetDecodeStats();
+        ImGui::Text("Patch Decode : %.1f MB from %.1f MB at %.0f MB/s", decode.DecodedBytes / 1048576.0,
+            decode.StoredBytes / 1048576.0, decode.DecodedBytes / 1048576.0 / std::max(decode.Seconds, 1e-9));
         auto matChanged = ImGui::Combo("Material Pack", reinterpret_cast<int*>(&mats), "Hill\0Mars\0Artificial\0");
         modeChanged |= matChanged;
         ImGui::DragFloat("Height Scale", &hScale, 1, 0.0, 10000.0);
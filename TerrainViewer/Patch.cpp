@@ -1,6 +1,7 @@
 #define NOMINMAX
 #include "Patch.h"
 
+#include <chrono>
 #include <string>
 #include <directxtk/BufferHelpers.h>
 #include "D3DHelper.h"
@@ -12,11 +13,17 @@
 using namespace DirectX;
 using namespace SimpleMath;
 
-Patch::Patch(const std::filesystem::path& path, int x, int y, ID3D11Device* device) : m_X(x), m_Y(y)
+Patch::Patch(const std::filesystem::path& path, int x, int y, ID3D11Device* device,
+    const PatchArchiveReader* archive) : m_X(x), m_Y(y), m_Archive(archive)
 {
     m_Resource = LoadResource(path, LOWEST_LOD, device);
 }
 
+Patch::DecodeStats Patch::GetDecodeStats()
+{
+    return { s_DecodedBytes.load(), s_StoredBytes.load(), s_DecodeNanoseconds.load() * 1e-9 };
+}
+
 Patch::RenderResource Patch::GetResource(const std::filesystem::path& path, int lod, ID3D11Device* device)
 {
     using namespace std::chrono_literals;
@@ -43,17 +50,65 @@ Patch::RenderResource Patch::GetResource(const std::filesystem::path& path, int
         0,
         XMINT2(m_X, m_Y),
         m_Resource->Idx16Bit,
+        m_Resource->Clusters,
+        m_Resource->ClusterCount,
+        {},
+        0,
+        m_Lod,
+        m_Resource->Stitches.data(),
+        static_cast<uint32_t>(m_Resource->Stitches.size()),
     };
 }
 
 std::shared_ptr<Patch::LodResource> Patch::LoadResource(
     const std::filesystem::path& path, int lod, ID3D11Device* device) const
 {
+    auto r = std::make_shared<LodResource>();
+    if (m_Archive)
+    {
+        // raw buffers are filled straight from the mapped file, encoded ones are decoded here on the
+        // streaming worker
+        const auto data = m_Archive->Get(m_X, m_Y, lod);
+        if (data.VertexCount == 0) return r;    // Empty, nothing to upload or draw
+        const size_t indexStride = data.Idx16Bit ? sizeof(uint16_t) : sizeof(uint32_t);
+        const void* vertices = data.Vertices;
+        const void* indices = data.Indices;
+        std::vector<MeshVertex> vtx;
+        std::vector<std::byte> idx;
+        if (data.Encoded)
+        {
+            const auto begin = std::chrono::steady_clock::now();
+            vtx.resize(data.VertexCount);
+            idx.resize(data.IndexCount * indexStride);
+            PatchArchive::DecodeVertices(vtx.data(), data.VertexCount, sizeof(MeshVertex),
+                data.Vertices, data.VertexBytes);
+            PatchArchive::DecodeIndices(idx.data(), data.IndexCount, static_cast<uint32_t>(indexStride),
+                data.Indices, data.IndexBytes);
+            vertices = vtx.data();
+            indices = idx.data();
+
+            s_DecodeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count();
+            s_DecodedBytes += vtx.size() * sizeof(MeshVertex) + idx.size();
+            s_StoredBytes += data.VertexBytes + data.IndexBytes;
+        }
+
+        ThrowIfFailed(CreateStaticBuffer(device, vertices, data.VertexCount, sizeof(MeshVertex),
+            D3D11_BIND_VERTEX_BUFFER, &r->Vb));
+        ThrowIfFailed(CreateStaticBuffer(device, indices, data.IndexCount, indexStride,
+            D3D11_BIND_INDEX_BUFFER, &r->Ib));
+        r->Idx16Bit = data.Idx16Bit;
+        r->IdxCnt = PatchArchive::SurfaceIndexCount(data.IndexCount, data.Stitches, data.StitchCount);
+        r->Clusters = data.Clusters;
+        r->ClusterCount = data.ClusterCount;
+        r->Stitches.assign(data.Stitches, data.Stitches + data.StitchCount);
+        return r;
+    }
+
     const auto vtx = LoadBinary<MeshVertex>(path.string() + "/" +
         std::to_string(m_X) + "_" + std::to_string(m_Y) + "/lod" + std::to_string(lod) + ".vtx");
     const auto idx = LoadBinary<std::byte>(path.string() + "/" +
         std::to_string(m_X) + "_" + std::to_string(m_Y) + "/lod" + std::to_string(lod) + ".idx");
-    auto r = std::make_shared<LodResource>();
     ThrowIfFailed(CreateStaticBuffer(
         device,
         vtx,
@@ -69,7 +124,12 @@ std::shared_ptr<Patch::LodResource> Patch::LoadResource(
     if (vtx.size() <= std::numeric_limits<uint16_t>::max())
         r->Idx16Bit = true;
     const size_t indexStride = r->Idx16Bit ? sizeof(uint16_t) : sizeof(uint32_t);
-    r->IdxCnt = static_cast<uint32_t>(idx.size() / indexStride);
+    const std::filesystem::path stitches = path.string() + "/" +
+        std::to_string(m_X) + "_" + std::to_string(m_Y) + "/lod" + std::to_string(lod) + ".stc";
+    if (exists(stitches))
+        r->Stitches = LoadBinary<PatchArchive::Stitch>(stitches);
+    r->IdxCnt = PatchArchive::SurfaceIndexCount(static_cast<uint32_t>(idx.size() / indexStride),
+        r->Stitches.data(), static_cast<uint32_t>(r->Stitches.size()));
     std::printf("Patch %2d %2d lod %d loaded\n", m_X, m_Y, lod);
     return r;
 }
@@ -1,17 +1,23 @@
 #pragma once
 
+#include <atomic>
 #include <d3d11.h>
 #include <filesystem>
 #include <future>
 #include <directxtk/SimpleMath.h>
 #include <wrl/client.h>
 
+#include "ClusterCuller.h"
+#include "PatchArchiveReader.h"
+
 constexpr float PATCH_SIZE = 255.0f;
 
 class Patch
 {
 public:
-    Patch(const std::filesystem::path& path, int x, int y, ID3D11Device* device);
+    // lods come from the mapped archive when there is one, from the loose x_y/lodN files otherwise
+    Patch(const std::filesystem::path& path, int x, int y, ID3D11Device* device,
+        const PatchArchiveReader* archive = nullptr);
     ~Patch() = default;
 
     struct RenderResource
@@ -22,10 +28,27 @@ public:
         uint32_t Color;
         DirectX::XMINT2 PatchXy; // Left bottom corner of the patch in global texture.
         bool Idx16Bit;
+        const PatchArchive::Cluster* Clusters;
+        uint32_t ClusterCount;
+        std::vector<ClusterCuller::Range> Ranges; // what survived culling, empty draws every index
+        int Level;  // positions are in 2^Level pixels, 0 for patches, higher for merged far field meshes
+        int Lod;    // the LOD resident now, which may lag behind the one asked for while it streams
+        const PatchArchive::Stitch* Stitches;
+        uint32_t StitchCount;
     };
 
     [[nodiscard]] RenderResource GetResource(const std::filesystem::path& path, int lod, ID3D11Device* device);
 
+    // what every patch has decoded from the archive since startup, summed over the streaming workers
+    struct DecodeStats
+    {
+        uint64_t DecodedBytes;  // vertex and index buffers as uploaded
+        uint64_t StoredBytes;   // the encoded bytes they came from
+        double Seconds;
+    };
+
+    [[nodiscard]] static DecodeStats GetDecodeStats();
+
     [[nodiscard]] DirectX::SimpleMath::Vector3 GetLocalPosition(const DirectX::XMINT2& cameraOffset) const
     {
         return { (m_X - cameraOffset.x) * PATCH_SIZE, 0.0f, (m_Y - cameraOffset.y) * PATCH_SIZE };
@@ -38,18 +61,26 @@ private:
     {
         Microsoft::WRL::ComPtr<ID3D11Buffer> Vb {};
         Microsoft::WRL::ComPtr<ID3D11Buffer> Ib {};
-        uint32_t IdxCnt {};
+        uint32_t IdxCnt {};                         // surface only, the stitching strips follow it
         bool Idx16Bit {};
+        const PatchArchive::Cluster* Clusters {};   // points into the archive mapping
+        uint32_t ClusterCount {};
+        std::vector<PatchArchive::Stitch> Stitches {};
     };
 
     std::shared_ptr<LodResource> LoadResource(const std::filesystem::path& path, int lod, ID3D11Device* device) const;
 
     const int m_X;
     const int m_Y;
+    const PatchArchiveReader* m_Archive;
     static constexpr int LOWEST_LOD = 2;
     int m_Lod = LOWEST_LOD;
     int m_LodStreaming = LOWEST_LOD;
 
+    inline static std::atomic<uint64_t> s_DecodedBytes = 0;
+    inline static std::atomic<uint64_t> s_StoredBytes = 0;
+    inline static std::atomic<uint64_t> s_DecodeNanoseconds = 0;
+
     std::shared_ptr<LodResource> m_Resource {};
     std::future<std::shared_ptr<LodResource>> m_Stream {};
 };
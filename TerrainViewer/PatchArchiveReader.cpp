@@ -0,0 +1,99 @@
+#define NOMINMAX
+#include "PatchArchiveReader.h"
+
+#include <stdexcept>
+#include <Windows.h>
+
+PatchArchiveReader::PatchArchiveReader(const std::filesystem::path& path)
+{
+    const auto fail = [this, &path](const char* what)
+    {
+        Close();
+        throw std::runtime_error(std::string(what) + " " + path.string());
+    };
+
+    m_File = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+    {
+        m_File = nullptr;
+        fail("failed to open");
+    }
+
+    LARGE_INTEGER size {};
+    if (!GetFileSizeEx(m_File, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(PatchArchive::Header)))
+        fail("truncated patch archive");
+    m_Size = static_cast<uint64_t>(size.QuadPart);
+
+    m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_Mapping) fail("failed to map");
+    m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_Data) fail("failed to map");
+
+    m_Header = reinterpret_cast<const PatchArchive::Header*>(m_Data);
+    if (m_Header->Magic != PatchArchive::Magic || m_Header->Version != PatchArchive::Version)
+        fail("unsupported patch archive");
+    const uint64_t entryCount = static_cast<uint64_t>(m_Header->PatchNx) * m_Header->PatchNy * m_Header->LodCount;
+    if (m_Header->FileSize != m_Size ||
+        m_Header->EntryOffset + entryCount * sizeof(PatchArchive::Entry) > m_Size)
+        fail("truncated patch archive");
+    m_Entries = reinterpret_cast<const PatchArchive::Entry*>(m_Data + m_Header->EntryOffset);
+}
+
+PatchArchiveReader::~PatchArchiveReader()
+{
+    Close();
+}
+
+void PatchArchiveReader::Close()
+{
+    if (m_Data) UnmapViewOfFile(m_Data);
+    if (m_Mapping) CloseHandle(m_Mapping);
+    if (m_File) CloseHandle(m_File);
+    m_Data = nullptr;
+    m_Mapping = nullptr;
+    m_File = nullptr;
+}
+
+bool PatchArchiveReader::Empty(const int x, const int y) const
+{
+    if (x < 0 || y < 0 || x >= PatchNx() || y >= PatchNy())
+        throw std::runtime_error("patch out of archive range");
+    return m_Entries[(static_cast<size_t>(y) * m_Header->PatchNx + x) * m_Header->LodCount].Flags & PatchArchive::Empty;
+}
+
+PatchArchiveReader::Lod PatchArchiveReader::Get(const int x, const int y, const int lod) const
+{
+    if (x < 0 || y < 0 || lod < 0 || x >= PatchNx() || y >= PatchNy() || lod >= LodCount())
+        throw std::runtime_error("patch out of archive range");
+
+    const auto& e = m_Entries[(static_cast<size_t>(y) * m_Header->PatchNx + x) * m_Header->LodCount + lod];
+    if (e.Flags & PatchArchive::Empty)
+        return { nullptr, nullptr, 0, 0, 0, 0, false, false, e.Error, nullptr, 0, nullptr, 0 };
+    if (e.VertexCount == 0)
+        throw std::runtime_error("patch missing from archive");
+    const bool encoded = e.Codec == PatchArchive::Meshopt;
+    if (!encoded && (e.VertexBytes != static_cast<uint64_t>(e.VertexCount) * m_Header->VertexStride ||
+        e.IndexBytes != static_cast<uint64_t>(e.IndexCount) * e.IndexWidth))
+        throw std::runtime_error("corrupt patch archive entry");
+    if (e.VertexOffset + e.VertexBytes > m_Size || e.IndexOffset + e.IndexBytes > m_Size ||
+        e.ClusterOffset + static_cast<uint64_t>(e.ClusterCount) * sizeof(PatchArchive::Cluster) > m_Size ||
+        e.StitchOffset + static_cast<uint64_t>(e.StitchCount) * sizeof(PatchArchive::Stitch) > m_Size)
+        throw std::runtime_error("corrupt patch archive entry");
+
+    return {
+        m_Data + e.VertexOffset,
+        m_Data + e.IndexOffset,
+        e.VertexCount,
+        e.IndexCount,
+        e.VertexBytes,
+        e.IndexBytes,
+        e.IndexWidth == sizeof(uint16_t),
+        encoded,
+        e.Error,
+        e.ClusterCount ? reinterpret_cast<const PatchArchive::Cluster*>(m_Data + e.ClusterOffset) : nullptr,
+        e.ClusterCount,
+        e.StitchCount ? reinterpret_cast<const PatchArchive::Stitch*>(m_Data + e.StitchOffset) : nullptr,
+        e.StitchCount,
+    };
+}
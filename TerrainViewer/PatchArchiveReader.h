@@ -0,0 +1,57 @@
+#pragma once
+
+#include <filesystem>
+
+#include "../HeightMapSplitter/PatchArchive.h"
+
+// Maps patches.pak read-only for the lifetime of the terrain. Lods point straight into the mapping,
+// raw ones become buffers without an intermediate copy and the OS pages them in on first use.
+class PatchArchiveReader
+{
+public:
+    // payloads as stored, Encoded ones go through PatchArchive::DecodeVertices / DecodeIndices
+    struct Lod
+    {
+        const void* Vertices;
+        const void* Indices;
+        uint32_t VertexCount;
+        uint32_t IndexCount;
+        uint32_t VertexBytes;
+        uint32_t IndexBytes;
+        bool Idx16Bit;
+        bool Encoded;
+        float Error;
+        const PatchArchive::Cluster* Clusters;  // in index buffer order, null when the LOD has none
+        uint32_t ClusterCount;
+        const PatchArchive::Stitch* Stitches;   // strips behind the surface indices, null when there are none
+        uint32_t StitchCount;
+    };
+
+    explicit PatchArchiveReader(const std::filesystem::path& path);
+    ~PatchArchiveReader();
+
+    PatchArchiveReader(const PatchArchiveReader&) = delete;
+    PatchArchiveReader& operator=(const PatchArchiveReader&) = delete;
+
+    [[nodiscard]] int PatchNx() const { return static_cast<int>(m_Header->PatchNx); }
+    [[nodiscard]] int PatchNy() const { return static_cast<int>(m_Header->PatchNy); }
+    [[nodiscard]] int LodCount() const { return static_cast<int>(m_Header->LodCount); }
+    [[nodiscard]] uint32_t VertexStride() const { return m_Header->VertexStride; }
+    [[nodiscard]] float HeightScale() const { return m_Header->HeightScale; }
+
+    // whether patch (x, y) was left without meshes on purpose, fully masked
+    [[nodiscard]] bool Empty(int x, int y) const;
+
+    // throws when the patch or lod is not in the archive, an Empty patch's lods have no vertices
+    [[nodiscard]] Lod Get(int x, int y, int lod) const;
+
+private:
+    void Close();
+
+    void* m_File = nullptr;
+    void* m_Mapping = nullptr;
+    const uint8_t* m_Data = nullptr;
+    uint64_t m_Size = 0;
+    const PatchArchive::Header* m_Header = nullptr;
+    const PatchArchive::Entry* m_Entries = nullptr;
+};
@@ -93,10 +93,14 @@ void TINRenderer::Render(
         ObjectConstants object;
         object.Color = patch.Color;
         object.PatchXy = patch.PatchXy;
+        object.Level = patch.Level;
         m_Cb1.SetData(context, object);
 
         context->IASetVertexBuffers(0, 1, &patch.Vb, &stride, &offset);
         context->IASetIndexBuffer(patch.Ib, patch.Idx16Bit ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
-        context->DrawIndexed(patch.IdxCnt, 0, 0);
+        if (patch.Ranges.empty())
+            context->DrawIndexed(patch.IdxCnt, 0, 0);
+        for (const auto& range : patch.Ranges)
+            context->DrawIndexed(range.IndexCount, range.IndexStart, 0);
     }
 }
@@ -28,7 +28,7 @@ protected:
     {
         DirectX::XMINT2 PatchXy;
         uint32_t Color;
-        int Padding;
+        int Level;  // the vertex shader scales positions by 2^Level before placing them at PatchXy
     };
 
     Microsoft::WRL::ComPtr<ID3D11VertexShader> m_Vs = nullptr;
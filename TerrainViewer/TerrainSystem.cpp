@@ -1,11 +1,13 @@
 #define NOMINMAX
 #include "TerrainSystem.h"
 
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <set>
 
 #include "BitMap.h"
+#include "VirtualTextureBaker.h"
 #include "../HeightMapSplitter/ThreadPool.h"
 
 constexpr size_t PATCH_NY = 8;
@@ -35,18 +37,37 @@ namespace
 
 void TerrainSystem::InitMeshPatches(ID3D11Device* device)
 {
+    int patchNx = PATCH_NX;
+    int patchNy = PATCH_NY;
+    if (exists(m_Path / "patches.pak"))
+    {
+        m_Archive = std::make_unique<PatchArchiveReader>(m_Path / "patches.pak");
+        if (m_Archive->VertexStride() != sizeof(MeshVertex))
+            throw std::runtime_error("patches.pak vertex layout mismatch");
+        patchNx = m_Archive->PatchNx();
+        patchNy = m_Archive->PatchNy();
+    }
+
     std::vector<std::future<std::shared_ptr<Patch>>> results;
-    for (int y = 0; y < PATCH_NY; ++y)
-        for (int x = 0; x < PATCH_NX; ++x)
+    // fully masked patches have no meshes and stay out of m_Patches, their bound tree leaves draw nothing
+    for (int y = 0; y < patchNy; ++y)
+    {
+        for (int x = 0; x < patchNx; ++x)
+        {
+            if (m_Archive ? m_Archive->Empty(x, y)
+                : !exists(m_Path / (std::to_string(x) + "_" + std::to_string(y))))
+                continue;
             results.emplace_back(g_ThreadPool.enqueue([this, device, x, y]
             {
-                return std::make_shared<Patch>(m_Path, x, y, device);
+                return std::make_shared<Patch>(m_Path, x, y, device, m_Archive.get());
             }));
+        }
+    }
 
     for (auto& result : results)
     {
         auto p = result.get();
-        int id = p->m_X + p->m_Y * PATCH_NX;
+        int id = p->m_X + p->m_Y * patchNx;
         m_Patches.emplace(id, std::move(p));
     }
 
@@ -56,6 +77,46 @@ void TerrainSystem::InitMeshPatches(ID3D11Device* device)
     nlohmann::json j;
     boundsFile >> j;
     m_BoundTree = std::make_unique<BoundTree>(j);
+    InitHlods(device);
+}
+
+void TerrainSystem::InitHlods(ID3D11Device* device)
+{
+    if (!exists(m_Path / "hlod.pak")) return;
+
+    // few and small next to the patches, loaded once and kept resident
+    const PatchArchiveReader archive(m_Path / "hlod.pak");
+    if (archive.VertexStride() != sizeof(MeshVertex))
+        throw std::runtime_error("hlod.pak vertex layout mismatch");
+
+    m_Hlods.resize(archive.PatchNx());
+    for (int i = 0; i < archive.PatchNx(); ++i)
+    {
+        const auto data = archive.Get(i, 0, 0);
+        const size_t indexStride = data.Idx16Bit ? sizeof(uint16_t) : sizeof(uint32_t);
+        std::vector<MeshVertex> vtx(data.VertexCount);
+        std::vector<std::byte> idx(data.IndexCount * indexStride);
+        if (data.Encoded)
+        {
+            PatchArchive::DecodeVertices(vtx.data(), data.VertexCount, sizeof(MeshVertex),
+                data.Vertices, data.VertexBytes);
+            PatchArchive::DecodeIndices(idx.data(), data.IndexCount, static_cast<uint32_t>(indexStride),
+                data.Indices, data.IndexBytes);
+        }
+        else
+        {
+            std::memcpy(vtx.data(), data.Vertices, vtx.size() * sizeof(MeshVertex));
+            std::memcpy(idx.data(), data.Indices, idx.size());
+        }
+
+        auto& r = m_Hlods[i];
+        ThrowIfFailed(CreateStaticBuffer(device, vtx, D3D11_BIND_VERTEX_BUFFER, &r.Vb));
+        ThrowIfFailed(CreateStaticBuffer(device, idx.data(), data.IndexCount, indexStride,
+            D3D11_BIND_INDEX_BUFFER, &r.Ib));
+        r.IdxCnt = data.IndexCount;
+        r.Idx16Bit = data.Idx16Bit;
+    }
+    std::printf("%zu hlod meshes loaded\n", m_Hlods.size());
 }
 
 void TerrainSystem::InitClipTextures(ID3D11Device* device)
@@ -96,32 +157,64 @@ void TerrainSystem::InitClipTextures(ID3D11Device* device)
     ClipmapLevel::BindTexture(m_HeightCm, m_AlbedoCm, m_NormalCm);
 }
 
+std::shared_ptr<TiledMap<HeightMap>> TerrainSystem::LoadSources(BitmapManager& manager,
+    const std::filesystem::path& path)
+{
+    // tile grid written by the splitter's source tiler, older assets come as 2 x 2
+    unsigned tilesX = 2;
+    unsigned tilesY = 2;
+    if (std::ifstream tilesFile(path / "tiles.json"); tilesFile.is_open())
+    {
+        nlohmann::json j;
+        tilesFile >> j;
+        tilesX = j["tilesX"].get<unsigned>();
+        tilesY = j["tilesY"].get<unsigned>();
+    }
+
+    auto loadTiles = [&path, tilesX, tilesY](const std::string& name, auto tag)
+    {
+        using Map = typename decltype(tag)::element_type;
+        std::vector<std::shared_ptr<Map>> tiles;
+        for (unsigned i = 0; i < tilesX * tilesY; ++i)
+            tiles.emplace_back(std::make_shared<Map>(path / (name + std::to_string(i) + ".dds")));
+        return std::make_shared<TiledMap<Map>>(std::move(tiles), tilesX, tilesY);
+    };
+    const auto hm = loadTiles("height", std::shared_ptr<HeightMap>());
+    const auto sm = loadTiles("splat", std::shared_ptr<SplatMap>());
+    const auto nm = loadTiles("normal", std::shared_ptr<NormalMap>());
+    manager.BindSource(hm, sm, nm);
+    return hm;
+}
+
 void TerrainSystem::InitClipmapLevels(ID3D11Device* device, const Vector3& view)
 {
     ClipmapLevelBase::LoadFootprintGeometry(m_Path / "clipmap", device);
-    const auto hm = std::make_shared<TiledMap<HeightMap>>(std::vector {
-        std::make_shared<HeightMap>(m_Path / "height0.dds"),
-        std::make_shared<HeightMap>(m_Path / "height1.dds"),
-        std::make_shared<HeightMap>(m_Path / "height2.dds"),
-        std::make_shared<HeightMap>(m_Path / "height3.dds"),
-    });
-
-    const auto sm = std::make_shared<TiledMap<SplatMap>>(std::vector {
-        std::make_shared<SplatMap>(m_Path / "splat0.dds"),
-        std::make_shared<SplatMap>(m_Path / "splat1.dds"),
-        std::make_shared<SplatMap>(m_Path / "splat2.dds"),
-        std::make_shared<SplatMap>(m_Path / "splat3.dds"),
-    });
-
-    const auto nm = std::make_shared<TiledMap<NormalMap>>(std::vector {
-        std::make_shared<NormalMap>(m_Path / "normal0.dds"),
-        std::make_shared<NormalMap>(m_Path / "normal1.dds"),
-        std::make_shared<NormalMap>(m_Path / "normal2.dds"),
-        std::make_shared<NormalMap>(m_Path / "normal3.dds"),
-    });
+    const auto hm = LoadSources(*m_SrcManager, m_Path);
+
+    // prefer the pyramid baked by the splitter, rebuild it from the tiles when it is missing or stale
+    std::shared_ptr<HeightPyramid> pyramid = nullptr;
+    const auto fits = [&hm](const HeightPyramid& p)
+    {
+        return p.Width() == hm->GetTotalWidth(0) && p.Height() == hm->GetTotalHeight(0);
+    };
+    for (const auto* name : { "tiles.pyramid", "height.pyramid" })
+    {
+        if (pyramid || !exists(m_Path / name)) continue;
+        pyramid = std::make_shared<HeightPyramid>(m_Path / name);
+        if (!fits(*pyramid)) pyramid = nullptr;
+    }
+    if (!pyramid)
+    {
+        pyramid = std::make_shared<HeightPyramid>(
+            static_cast<int>(hm->GetTotalWidth(0)), static_cast<int>(hm->GetTotalHeight(0)),
+            [&hm](const int x, const int y)
+            {
+                return hm->GetVal(x, y, 0) / static_cast<float>(std::numeric_limits<uint16_t>::max());
+            });
+    }
 
     InitClipTextures(device);
-    m_SrcManager->BindSource(hm, sm, nm);
+    ClipmapLevel::BindHeightPyramid(pyramid);
     ClipmapLevel::BindSourceManager(m_SrcManager);
 
     for (int i = 0; i < LevelCount; ++i)
@@ -156,7 +249,7 @@ void TerrainSystem::ResetClipmapTexture()
     }
 }
 
-void TerrainSystem::BindMaterials(const std::vector<std::filesystem::path>& mats) const
+void TerrainSystem::LoadMaterials(BitmapManager& manager, const std::vector<std::filesystem::path>& mats)
 {
     const std::vector albedo =
     {
@@ -182,7 +275,40 @@ void TerrainSystem::BindMaterials(const std::vector<std::filesystem::path>& mats
         std::make_shared<HeightMap>(mats[3] / "height.dds"),
     };
 
-    m_SrcManager->BindMaterial(albedo, normal, height);
+    manager.BindMaterial(albedo, normal, height);
+}
+
+void TerrainSystem::BindMaterials(const std::vector<std::filesystem::path>& mats) const
+{
+    LoadMaterials(*m_SrcManager, mats);
+
+    // the baked blends stand in for the live ones only when they were baked from these very sources and
+    // materials, and every level wraps where the splat tiles bound now make the clipmap wrap
+    std::shared_ptr<const VirtualTextureReader> baked = nullptr;
+    if (exists(m_Path / "vt.pak"))
+    {
+        baked = std::make_shared<const VirtualTextureReader>(m_Path / "vt.pak");
+        bool fits = baked->Complete() && baked->Header().SourceKey == VirtualTexture::SourceKey(m_Path, mats);
+        for (int i = 0; fits && i < baked->LevelCount(); ++i)
+        {
+            const auto& l = baked->Level(i);
+            fits = l.WidthBlocks == m_SrcManager->GetSplatWidth(i) * VirtualTexture::SampleRatio /
+                VirtualTexture::BlockTexels && l.HeightBlocks == m_SrcManager->GetSplatHeight(i) *
+                VirtualTexture::SampleRatio / VirtualTexture::BlockTexels;
+        }
+        if (!fits) baked = nullptr;
+        std::printf("vt.pak %s\n", baked ? "bound" : "baked from other sources, blending live");
+    }
+    m_SrcManager->BindVirtualTexture(baked);
+}
+
+void TerrainSystem::BakeVirtualTexture(const std::filesystem::path& path,
+    const std::vector<std::filesystem::path>& mats, const int blendMode, const ShardPlan& shard)
+{
+    const auto manager = std::make_shared<BitmapManager>();
+    LoadSources(*manager, path);
+    LoadMaterials(*manager, mats);
+    VirtualTextureBaker(manager, LevelCount, blendMode, VirtualTexture::SourceKey(path, mats)).Run(path, shard);
 }
 
 TerrainSystem::PatchRenderResource TerrainSystem::TickMeshTerrain(
@@ -191,11 +317,12 @@ TerrainSystem::PatchRenderResource TerrainSystem::TickMeshTerrain(
 {
     std::vector<int> visible;
     std::vector<int> lods;
+    std::vector<const BoundTree::Node*> hlods;
     std::function<void(const BoundTree::Node* node)> recursiveCull = [&](const BoundTree::Node* node)
     {
         if (node == nullptr) return;
 
-        const auto& [minH, maxH, h, w, x, y, id] = node->m_Bound;
+        const auto& [minH, maxH, h, w, x, y, id, hlod] = node->m_Bound;
         const auto extents = Vector3(
             w * 0.5f,
             (maxH - minH) * yScale * 0.5f,
@@ -223,6 +350,16 @@ TerrainSystem::PatchRenderResource TerrainSystem::TickMeshTerrain(
             return;
         }
 
+        // past the coarsest patch distance scaled by the node's size, one merged mesh stands in for
+        // the whole subtree
+        if (hlod >= 0 && hlod < static_cast<int>(m_Hlods.size()) &&
+            (frustumLocal.Origin - center).Length() > *G_DISTANCES.rbegin() * std::max(w, h) / PATCH_SIZE)
+        {
+            bbs.emplace_back(bb);
+            hlods.emplace_back(node);
+            return;
+        }
+
         for (const auto& child : node->m_Children)
             recursiveCull(child.get());
     };
@@ -239,11 +376,66 @@ TerrainSystem::PatchRenderResource TerrainSystem::TickMeshTerrain(
         const auto lod = lods[i];
         if (m_Patches.find(id) != m_Patches.end())
         {
-            auto rr = m_Patches.at(id)->GetResource(m_Path, lod, device);
+            const auto& patch = m_Patches.at(id);
+            auto rr = patch->GetResource(m_Path, lod, device);
             rr.Color = G_COLORS[lod];
-            r.Patches.emplace_back(rr);
+            if (rr.ClusterCount)
+            {
+                // same placement as the patch bounds above
+                const Vector3 origin(
+                    (patch->m_X - camXyForCull.x) * PATCH_SIZE,
+                    1000.0f,
+                    (patch->m_Y - camXyForCull.y) * PATCH_SIZE);
+                ClusterCuller::Cull(rr.Clusters, rr.ClusterCount, origin, frustumLocal,
+                    yScale, m_Archive->HeightScale(), rr.Ranges, &r.Clusters);
+                if (rr.Ranges.empty()) continue;
+            }
+            r.Patches.emplace_back(std::move(rr));
         }
     }
+
+    // next to a neighbour showing a coarser LOD the patch also draws the strip closing that seam
+    std::map<std::pair<int, int>, int> drawnLods;
+    for (const auto& patch : r.Patches)
+        drawnLods[{ patch.PatchXy.x, patch.PatchXy.y }] = patch.Lod;
+    for (auto& patch : r.Patches)
+    {
+        // left, right, top, bottom as the splitter's EdgeMask::Side
+        const std::pair<int, int> neighbours[4] =
+        {
+            { patch.PatchXy.x - 1, patch.PatchXy.y }, { patch.PatchXy.x + 1, patch.PatchXy.y },
+            { patch.PatchXy.x, patch.PatchXy.y - 1 }, { patch.PatchXy.x, patch.PatchXy.y + 1 },
+        };
+        for (uint32_t i = 0; i < patch.StitchCount; ++i)
+        {
+            const auto& stitch = patch.Stitches[i];
+            const auto neighbour = drawnLods.find(neighbours[stitch.Side]);
+            if (neighbour == drawnLods.end() || neighbour->second != static_cast<int>(stitch.NeighbourLod)) continue;
+            if (patch.Ranges.empty()) patch.Ranges.push_back({ 0, patch.IdxCnt });
+            patch.Ranges.push_back({ stitch.IndexOffset, stitch.IndexCount });
+        }
+    }
+
+    for (const auto* node : hlods)
+    {
+        const auto& bound = node->m_Bound;
+        const auto& mesh = m_Hlods[bound.HlodIdx];
+        r.Patches.push_back({
+            mesh.Vb.Get(),
+            mesh.Ib.Get(),
+            mesh.IdxCnt,
+            G_COLORS[std::size(G_COLORS) - 1],
+            XMINT2(bound.AreaX, bound.AreaY),
+            mesh.Idx16Bit,
+            nullptr,
+            0,
+            {},
+            BoundTree::HlodLevel(bound),
+            0,
+            nullptr,
+            0,
+        });
+    }
     return std::move(r);
 }
 
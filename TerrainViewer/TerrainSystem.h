@@ -7,6 +7,7 @@
 
 #include "Texture2D.h"
 #include "../HeightMapSplitter/BoundTree.h"
+#include "../HeightMapSplitter/ShardPlan.h"
 
 class TerrainSystem
 {
@@ -17,6 +18,7 @@ public:
         ID3D11ShaderResourceView* Normal {};
         ID3D11ShaderResourceView* Albedo {};
         std::vector<Patch::RenderResource> Patches {};
+        ClusterCuller::Stats Clusters {};
 
         PatchRenderResource() = default;
     };
@@ -56,6 +58,10 @@ public:
     void ResetClipmapTexture();
     void BindMaterials(const std::vector<std::filesystem::path>& mats) const;
 
+    // bakes path/vt.pak from the same sources and materials the clipmap blends, without a device
+    static void BakeVirtualTexture(const std::filesystem::path& path, const std::vector<std::filesystem::path>& mats,
+        int blendMode, const ShardPlan& shard = {});
+
     [[nodiscard]] PatchRenderResource TickMeshTerrain(
         const DirectX::XMINT2& camXyForCull,
         const DirectX::BoundingFrustum& frustumLocal, float yScale,
@@ -73,15 +79,33 @@ public:
     static constexpr float LevelZeroScale = 1.0f; // 1 m per grid
 
 protected:
+    // bind the source tiles and the material pack into manager, LoadSources returns the height tiles
+    static std::shared_ptr<DirectX::TiledMap<DirectX::HeightMap>> LoadSources(
+        BitmapManager& manager, const std::filesystem::path& path);
+    static void LoadMaterials(BitmapManager& manager, const std::vector<std::filesystem::path>& mats);
+
     void InitMeshPatches(ID3D11Device* device);
+    void InitHlods(ID3D11Device* device);
     void InitClipTextures(ID3D11Device* device);
     void InitClipmapLevels(ID3D11Device* device, const DirectX::SimpleMath::Vector3& view);
     [[nodiscard]] ClipmapRenderResource GetClipmapRenderResource(
         const DirectX::BoundingFrustum& frustum, float hScl) const;
 
+    // declared before the patches, which read from it until they are gone
+    std::unique_ptr<PatchArchiveReader> m_Archive = nullptr;
     std::map<int, std::shared_ptr<Patch>> m_Patches {};
     std::unique_ptr<BoundTree> m_BoundTree = nullptr;
 
+    // merged meshes of the bound tree's internal nodes, drawn instead of their subtree far away
+    struct HlodResource
+    {
+        Microsoft::WRL::ComPtr<ID3D11Buffer> Vb {};
+        Microsoft::WRL::ComPtr<ID3D11Buffer> Ib {};
+        uint32_t IdxCnt {};
+        bool Idx16Bit {};
+    };
+    std::vector<HlodResource> m_Hlods {};
+
     std::vector<ClipmapLevel> m_Levels {};
     std::shared_ptr<BitmapManager> m_SrcManager = nullptr;
     std::shared_ptr<DirectX::ClipmapTexture> m_HeightCm {};
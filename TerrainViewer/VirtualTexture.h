@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "MaterialBlender.h"
+
+// vt.pak: the albedo and normal blends of every clipmap level over the whole world, baked offline as the
+// BC3 blocks the clipmap textures take, so a shipping build copies them instead of blending live.
+// Header, the level table, then each level's tile rows from DataAlignment on. A tile covers TileTexels
+// square, its albedo blocks then its normal blocks, blocks row major as CompressBlocksBC3 lays them out.
+// Levels wrap around like the sources they were blended from, the last tiles of a row or column may run
+// past the wrap and repeat its start. A shard's file is the same with only its own rows of each level.
+namespace VirtualTexture
+{
+    constexpr uint32_t Magic = 0x58545654; // "TVTX"
+    constexpr uint32_t Version = 1;
+    constexpr uint32_t TileTexels = 128;
+    constexpr uint32_t BlockTexels = 4;
+    constexpr uint32_t BlockBytes = 16;     // BC3
+    constexpr uint32_t TileBlocks = TileTexels / BlockTexels;
+    constexpr uint64_t LayerBytes = static_cast<uint64_t>(TileBlocks) * TileBlocks * BlockBytes;
+    constexpr uint64_t TileBytes = 2 * LayerBytes;
+    constexpr uint64_t DataAlignment = 4096;
+
+    // blended texels per splat pixel, the same for both blenders
+    constexpr uint32_t SampleRatio = AlbedoBlender::SampleRatio;
+    constexpr uint32_t TileSplats = TileTexels / SampleRatio;
+    static_assert(NormalBlender::SampleRatio == SampleRatio && TileTexels % SampleRatio == 0 &&
+        SampleRatio % BlockTexels == 0, "tiles hold whole splat pixels of whole blocks");
+
+    enum Layer : uint32_t
+    {
+        Albedo = 0,
+        Normal = 1,
+    };
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t LevelCount;
+        uint32_t TileTexels;
+        uint32_t BlendMethod;   // NormalBlender::BlendMethod the normals were blended with
+        uint32_t Reserved;
+        uint64_t SourceKey;     // SourceKey() of the sources and the material pack blended
+        uint64_t FileSize;
+    };
+
+    struct Level
+    {
+        uint32_t WidthBlocks;   // where the level wraps
+        uint32_t HeightBlocks;
+        uint32_t TilesX;
+        uint32_t TilesY;
+        uint32_t RowBegin;      // tile rows stored, all of them but in a shard's file
+        uint32_t RowEnd;
+        uint64_t Offset;        // of tile (0, RowBegin)
+    };
+
+    static_assert(sizeof(Header) == 40 && sizeof(Level) == 32, "packed on disk as is");
+
+    constexpr uint64_t Align(const uint64_t offset)
+    {
+        return (offset + DataAlignment - 1) & ~(DataAlignment - 1);
+    }
+
+    // FNV-1a over the name, size and last write time of every file a bake reads: the source tiles in dir and
+    // the textures of each material. Repainting a tile or a material changes the key without reading gigabytes
+    // at every bind. Copies that do not keep the write times only cost a live blend, never a stale bake.
+    inline uint64_t SourceKey(const std::filesystem::path& dir, const std::vector<std::filesystem::path>& materials)
+    {
+        std::vector<std::filesystem::path> files;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, error))
+        {
+            const auto name = entry.path().filename().u8string();
+            const bool tile = entry.path().extension() == ".dds" &&
+                (name.rfind("height", 0) == 0 || name.rfind("splat", 0) == 0 || name.rfind("normal", 0) == 0);
+            if (tile || name == "tiles.json") files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& material : materials)
+            for (const char* name : { "albedo.dds", "normal.dds", "height.dds" })
+                files.push_back(material / name);
+
+        uint64_t key = 0xcbf29ce484222325ull;
+        const auto add = [&key](const void* data, const size_t size)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                key ^= static_cast<const uint8_t*>(data)[i];
+                key *= 0x100000001b3ull;
+            }
+        };
+        for (const auto& file : files)
+        {
+            // named from their directory on, the same assets give the same key wherever they live
+            const auto name = (file.parent_path().filename() / file.filename()).u8string() + "/";
+            const uint64_t size = std::filesystem::file_size(file, error);
+            const int64_t time = std::filesystem::last_write_time(file, error).time_since_epoch().count();
+            add(name.data(), name.size());
+            add(&size, sizeof(size));
+            add(&time, sizeof(time));
+        }
+        return key;
+    }
+}
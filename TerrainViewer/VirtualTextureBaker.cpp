@@ -0,0 +1,183 @@
+#define NOMINMAX
+#include "VirtualTextureBaker.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "VirtualTextureReader.h"
+#include "../HeightMapSplitter/Parallel.h"
+
+using namespace VirtualTexture;
+
+namespace
+{
+    void WriteArchive(const std::filesystem::path& path, const VirtualTexture::Header& header,
+        const std::vector<VirtualTexture::Level>& levels,
+        const std::function<void(const std::function<void(const std::vector<uint8_t>&)>&)>& rows)
+    {
+        // written under a temporary name and renamed, a file that exists is complete
+        create_directories(path.parent_path());
+        const auto temporary = path.u8string() + ".tmp";
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file) throw std::runtime_error("failed to create " + temporary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(VirtualTexture::Level));
+        const std::vector<char> padding(Align(file.tellp()) - static_cast<uint64_t>(file.tellp()));
+        file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+        rows([&file](const std::vector<uint8_t>& row)
+        {
+            file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+        });
+        file.close();
+        if (!file || std::filesystem::file_size(temporary) != header.FileSize)
+            throw std::runtime_error("failed to write " + temporary);
+        std::filesystem::rename(temporary, path);
+        std::printf("%s generated\n", path.u8string().c_str());
+    }
+
+    // lays the levels out back to back behind the table and returns the file size
+    uint64_t Place(std::vector<VirtualTexture::Level>& levels)
+    {
+        uint64_t offset = Align(sizeof(VirtualTexture::Header) + levels.size() * sizeof(VirtualTexture::Level));
+        for (auto& l : levels)
+        {
+            l.Offset = offset;
+            offset += static_cast<uint64_t>(l.RowEnd - l.RowBegin) * l.TilesX * TileBytes;
+        }
+        return offset;
+    }
+}
+
+VirtualTextureBaker::VirtualTextureBaker(std::shared_ptr<const BitmapManager> source, const int levelCount,
+    const int blendMethod, const uint64_t sourceKey) :
+    m_Source(std::move(source)), m_LevelCount(levelCount), m_BlendMethod(blendMethod), m_SourceKey(sourceKey)
+{
+}
+
+std::filesystem::path VirtualTextureBaker::ShardPath(const std::filesystem::path& dir, const int index)
+{
+    return dir / "shards" / ("vt_shard_" + std::to_string(index) + ".pak");
+}
+
+void VirtualTextureBaker::Run(const std::filesystem::path& dir, const ShardPlan& shard) const
+{
+    VirtualTexture::Header header { Magic, Version, static_cast<uint32_t>(m_LevelCount), TileTexels,
+        static_cast<uint32_t>(m_BlendMethod), 0, m_SourceKey, 0 };
+    std::vector<VirtualTexture::Level> levels(m_LevelCount);
+    for (int i = 0; i < m_LevelCount; ++i)
+    {
+        const auto width = static_cast<uint32_t>(m_Source->GetSplatWidth(i) * SampleRatio);
+        const auto height = static_cast<uint32_t>(m_Source->GetSplatHeight(i) * SampleRatio);
+        auto& l = levels[i];
+        l.WidthBlocks = width / BlockTexels;
+        l.HeightBlocks = height / BlockTexels;
+        l.TilesX = (width + TileTexels - 1) / TileTexels;
+        l.TilesY = (height + TileTexels - 1) / TileTexels;
+        l.RowBegin = static_cast<uint32_t>(shard.RowBegin(static_cast<int>(l.TilesY)));
+        l.RowEnd = static_cast<uint32_t>(shard.RowEnd(static_cast<int>(l.TilesY)));
+    }
+    header.FileSize = Place(levels);
+
+    const auto path = shard.Count ? ShardPath(dir, shard.Index) : dir / "vt.pak";
+    WriteArchive(path, header, levels, [this, &levels](const auto& write)
+    {
+        // the next row is blended while the last one is written
+        std::vector<uint8_t> baking, writing;
+        std::future<void> written;
+        for (int level = 0; level < m_LevelCount; ++level)
+        {
+            const auto& l = levels[level];
+            const auto begin = std::chrono::steady_clock::now();
+            for (uint32_t row = l.RowBegin; row < l.RowEnd; ++row)
+            {
+                baking.resize(static_cast<size_t>(l.TilesX) * TileBytes);
+                ParallelFor(0, static_cast<int>(l.TilesX), 1, [&](const int b, const int e)
+                {
+                    for (int tx = b; tx < e; ++tx)
+                    {
+                        const int x = tx * static_cast<int>(TileSplats);
+                        const int y = static_cast<int>(row * TileSplats);
+                        const auto albedo = m_Source->BlendAlbedoRoughnessBc3(x, y, TileSplats, TileSplats, level);
+                        const auto normal = m_Source->BlendNormalOcclusionBc3(x, y, TileSplats, TileSplats, level,
+                            m_BlendMethod);
+                        uint8_t* tile = baking.data() + static_cast<size_t>(tx) * TileBytes;
+                        std::memcpy(tile + Albedo * LayerBytes, albedo.data(), LayerBytes);
+                        std::memcpy(tile + Normal * LayerBytes, normal.data(), LayerBytes);
+                    }
+                });
+                if (written.valid()) written.get();
+                std::swap(baking, writing);
+                written = std::async(std::launch::async, [&write, &writing] { write(writing); });
+            }
+            const std::chrono::duration<float> seconds = std::chrono::steady_clock::now() - begin;
+            std::printf("vt level %d: %u x %u tiles baked in %.1f s\n", level, l.TilesX, l.RowEnd - l.RowBegin,
+                seconds.count());
+        }
+        if (written.valid()) written.get();
+    });
+}
+
+void VirtualTextureBaker::Merge(const std::filesystem::path& dir, const int count)
+{
+    std::vector<std::unique_ptr<VirtualTextureReader>> shards;
+    for (int i = 0; i < count; ++i)
+    {
+        const auto path = ShardPath(dir, i);
+        if (!exists(path))
+            throw std::runtime_error("shard " + std::to_string(i) + " of " + std::to_string(count) +
+                " has not finished, " + path.u8string() + " is missing");
+        shards.emplace_back(std::make_unique<VirtualTextureReader>(path));
+    }
+
+    // the shards have to come from the same bake and cover every row of every level once, in order
+    const auto& first = *shards.front();
+    VirtualTexture::Header header = first.Header();
+    std::vector<VirtualTexture::Level> levels(first.LevelCount());
+    for (int level = 0; level < first.LevelCount(); ++level)
+    {
+        auto& l = levels[level] = first.Level(level);
+        l.RowBegin = 0;
+        l.RowEnd = 0;
+        for (const auto& shard : shards)
+        {
+            const auto& h = shard->Header();
+            const auto& s = shard->Level(level);
+            if (h.LevelCount != header.LevelCount || h.BlendMethod != header.BlendMethod ||
+                h.SourceKey != header.SourceKey || s.WidthBlocks != l.WidthBlocks ||
+                s.HeightBlocks != l.HeightBlocks || s.TilesX != l.TilesX || s.TilesY != l.TilesY)
+                throw std::runtime_error("virtual texture shards come from different bakes");
+            if (s.RowBegin != l.RowEnd)
+                throw std::runtime_error("virtual texture shards leave a gap in level " + std::to_string(level));
+            l.RowEnd = s.RowEnd;
+        }
+        if (l.RowEnd != l.TilesY)
+            throw std::runtime_error("virtual texture shards leave a gap in level " + std::to_string(level));
+    }
+    header.FileSize = Place(levels);
+
+    WriteArchive(dir / "vt.pak", header, levels, [&shards, &levels](const auto& write)
+    {
+        std::vector<uint8_t> row;
+        for (int level = 0; level < static_cast<int>(levels.size()); ++level)
+        {
+            for (const auto& shard : shards)
+            {
+                const auto& s = shard->Level(level);
+                for (uint32_t r = s.RowBegin; r < s.RowEnd; ++r)
+                {
+                    const uint8_t* data = shard->Row(level, r);
+                    row.assign(data, data + static_cast<size_t>(s.TilesX) * TileBytes);
+                    write(row);
+                }
+            }
+        }
+    });
+}
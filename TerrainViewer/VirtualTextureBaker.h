@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+#include "BitmapManager.h"
+#include "../HeightMapSplitter/ShardPlan.h"
+
+// Bakes vt.pak with the blenders and the BC3 compression the clipmap runs live, a tile at a time on
+// g_ThreadPool, one tile row after the other while the previous row is written. A sharded bake takes the
+// same share of the tile rows of every level and leaves vt_shard_<Index>.pak, Merge() then joins them.
+class VirtualTextureBaker
+{
+public:
+    // source has its sources and materials bound and nothing baked, levelCount matches the clipmap's
+    VirtualTextureBaker(std::shared_ptr<const BitmapManager> source, int levelCount, int blendMethod,
+        uint64_t sourceKey);
+
+    // bakes the shard's rows of every level into dir, all of them into vt.pak when shard.Count is 0
+    void Run(const std::filesystem::path& dir, const ShardPlan& shard = {}) const;
+
+    // joins the count shard files in dir into vt.pak, once they all exist and agree
+    static void Merge(const std::filesystem::path& dir, int count);
+
+    [[nodiscard]] static std::filesystem::path ShardPath(const std::filesystem::path& dir, int index);
+
+private:
+    std::shared_ptr<const BitmapManager> m_Source;
+    const int m_LevelCount;
+    const int m_BlendMethod;
+    const uint64_t m_SourceKey;
+};
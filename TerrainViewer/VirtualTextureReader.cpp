@@ -0,0 +1,117 @@
+#define NOMINMAX
+#include "VirtualTextureReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <Windows.h>
+
+#include "D3DHelper.h"
+
+using namespace VirtualTexture;
+
+VirtualTextureReader::VirtualTextureReader(const std::filesystem::path& path)
+{
+    const auto fail = [this, &path](const char* what)
+    {
+        Close();
+        throw std::runtime_error(std::string(what) + " " + path.string());
+    };
+
+    m_File = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE)
+    {
+        m_File = nullptr;
+        fail("failed to open");
+    }
+
+    LARGE_INTEGER size {};
+    if (!GetFileSizeEx(m_File, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(VirtualTexture::Header)))
+        fail("truncated virtual texture");
+    m_Size = static_cast<uint64_t>(size.QuadPart);
+
+    m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_Mapping) fail("failed to map");
+    m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_Data) fail("failed to map");
+
+    m_Header = reinterpret_cast<const VirtualTexture::Header*>(m_Data);
+    if (m_Header->Magic != Magic || m_Header->Version != Version || m_Header->TileTexels != TileTexels)
+        fail("unsupported virtual texture");
+    if (m_Header->FileSize != m_Size ||
+        sizeof(VirtualTexture::Header) + m_Header->LevelCount * sizeof(VirtualTexture::Level) > m_Size)
+        fail("truncated virtual texture");
+    m_Levels = reinterpret_cast<const VirtualTexture::Level*>(m_Data + sizeof(VirtualTexture::Header));
+    for (int i = 0; i < LevelCount(); ++i)
+    {
+        const auto& l = m_Levels[i];
+        if (l.RowBegin > l.RowEnd || l.RowEnd > l.TilesY ||
+            static_cast<uint64_t>(l.TilesX) * TileBlocks < l.WidthBlocks ||
+            static_cast<uint64_t>(l.TilesY) * TileBlocks < l.HeightBlocks ||
+            l.Offset + static_cast<uint64_t>(l.RowEnd - l.RowBegin) * l.TilesX * TileBytes > m_Size)
+            fail("corrupt virtual texture");
+    }
+}
+
+VirtualTextureReader::~VirtualTextureReader()
+{
+    Close();
+}
+
+void VirtualTextureReader::Close()
+{
+    if (m_Data) UnmapViewOfFile(m_Data);
+    if (m_Mapping) CloseHandle(m_Mapping);
+    if (m_File) CloseHandle(m_File);
+    m_Data = nullptr;
+    m_Mapping = nullptr;
+    m_File = nullptr;
+}
+
+bool VirtualTextureReader::Complete() const
+{
+    return std::all_of(m_Levels, m_Levels + LevelCount(), [](const VirtualTexture::Level& l)
+    {
+        return l.RowBegin == 0 && l.RowEnd == l.TilesY;
+    });
+}
+
+const uint8_t* VirtualTextureReader::Row(const int level, const uint32_t row) const
+{
+    if (level < 0 || level >= LevelCount())
+        throw std::runtime_error("level out of virtual texture range");
+    const auto& l = m_Levels[level];
+    if (row < l.RowBegin || row >= l.RowEnd)
+        throw std::runtime_error("tile row missing from virtual texture");
+    return m_Data + l.Offset + static_cast<uint64_t>(row - l.RowBegin) * l.TilesX * TileBytes;
+}
+
+std::vector<uint8_t> VirtualTextureReader::Copy(const Layer layer, const int x, const int y, const unsigned w,
+    const unsigned h, const int level) const
+{
+    constexpr uint32_t ratio = SampleRatio / BlockTexels;
+    const auto& l = m_Levels[level];
+    const uint32_t bw = w * ratio;
+    const uint32_t bh = h * ratio;
+    std::vector<uint8_t> dst(static_cast<size_t>(bw) * bh * BlockBytes);
+
+    // every block row is a few runs of consecutive blocks, broken where a tile ends or the level wraps
+    for (uint32_t row = 0; row < bh; ++row)
+    {
+        const uint32_t gy = WarpMod(static_cast<int64_t>(y) * ratio + row, l.HeightBlocks);
+        const uint8_t* tiles = Row(level, gy / TileBlocks) + layer * LayerBytes +
+            static_cast<uint64_t>(gy % TileBlocks) * TileBlocks * BlockBytes;
+        uint8_t* out = dst.data() + static_cast<size_t>(row) * bw * BlockBytes;
+        for (uint32_t col = 0; col < bw;)
+        {
+            const uint32_t gx = WarpMod(static_cast<int64_t>(x) * ratio + col, l.WidthBlocks);
+            const uint32_t run = std::min({ bw - col, TileBlocks - gx % TileBlocks, l.WidthBlocks - gx });
+            std::memcpy(out + static_cast<size_t>(col) * BlockBytes,
+                tiles + static_cast<uint64_t>(gx / TileBlocks) * TileBytes + (gx % TileBlocks) * BlockBytes,
+                static_cast<size_t>(run) * BlockBytes);
+            col += run;
+        }
+    }
+    return dst;
+}
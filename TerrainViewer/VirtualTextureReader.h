@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "VirtualTexture.h"
+
+// Maps vt.pak, or a shard of it, read-only. Copy() gathers the blocks of a clipmap update straight out
+// of the mapping, the OS pages in only the tiles the camera comes near.
+class VirtualTextureReader
+{
+public:
+    explicit VirtualTextureReader(const std::filesystem::path& path);
+    ~VirtualTextureReader();
+
+    VirtualTextureReader(const VirtualTextureReader&) = delete;
+    VirtualTextureReader& operator=(const VirtualTextureReader&) = delete;
+
+    [[nodiscard]] const VirtualTexture::Header& Header() const { return *m_Header; }
+    [[nodiscard]] int LevelCount() const { return static_cast<int>(m_Header->LevelCount); }
+    [[nodiscard]] const VirtualTexture::Level& Level(const int level) const { return m_Levels[level]; }
+
+    // every tile row of every level is stored, false for a shard's file
+    [[nodiscard]] bool Complete() const;
+
+    // the TilesX tiles of a stored row, throws for a row the file does not hold
+    [[nodiscard]] const uint8_t* Row(int level, uint32_t row) const;
+
+    // the BC3 blocks of w x h splat pixels at (x, y), wrapped, laid out as
+    // BitmapManager::BlendAlbedoRoughnessBc3 / BlendNormalOcclusionBc3 return them
+    [[nodiscard]] std::vector<uint8_t> Copy(VirtualTexture::Layer layer, int x, int y, unsigned w, unsigned h,
+        int level) const;
+
+private:
+    void Close();
+
+    void* m_File = nullptr;
+    void* m_Mapping = nullptr;
+    const uint8_t* m_Data = nullptr;
+    uint64_t m_Size = 0;
+    const VirtualTexture::Header* m_Header = nullptr;
+    const VirtualTexture::Level* m_Levels = nullptr;
+};
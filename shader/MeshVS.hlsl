@@ -4,7 +4,7 @@ cbuffer ObjectConstants : register(b1)
 {
 int2 g_PatchXy;
 uint g_PatchColor;
-int g_Pad1[1];
+int g_Level;      // HLOD vertices step 2^g_Level pixels, patch LODs have 0
 }
 
 SamplerState g_PointClamp : register(s0);
@@ -19,10 +19,11 @@ void main(
     g_Height.GetDimensions(texSz.x, texSz.y);
     texSz = 1.0f / texSz;
 
-    const float2 uv = ((positionL + g_PatchXy) * PatchScale + 0.5f) * texSz;
+    const float2 positionP = positionL * (1 << g_Level) + g_PatchXy;
+    const float2 uv = (positionP * PatchScale + 0.5f) * texSz;
     const float h = g_Height.SampleLevel(g_PointClamp, uv, 0);
 
-    float3 positionW = float3(positionL.x + g_PatchXy.x, h, positionL.y + g_PatchXy.y);
+    float3 positionW = float3(positionP.x, h, positionP.y);
     positionW *= float3(PatchScale, HeightMapScale, PatchScale);
     positionW.y += 1000.0f;
 
@@ -4,7 +4,7 @@ cbuffer ObjectConstants : register(b1)
 {
 uint2 g_PatchXy;
 uint g_PatchColor;
-int g_Pad1[1];
+int g_Level;
 }
 
 void main(out float4 color : SV_TARGET)